@@ -0,0 +1,756 @@
+#include "kvparse.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <zlib.h>
+
+using std::string;
+using std::vector;
+
+enum class bench_replacement { generational, steady_state, elitist, crowding, tournament, random };
+
+template <>
+struct kvparse_enum_names<bench_replacement>
+{
+	static constexpr std::array<std::pair<string_view,bench_replacement>,6> names = {{
+		{ "generational", bench_replacement::generational },
+		{ "steady_state", bench_replacement::steady_state },
+		{ "elitist", bench_replacement::elitist },
+		{ "crowding", bench_replacement::crowding },
+		{ "tournament", bench_replacement::tournament },
+		{ "random", bench_replacement::random },
+	}};
+};
+
+namespace {
+
+typedef std::chrono::steady_clock bench_clock;
+
+double seconds_since(bench_clock::time_point start)
+{
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+const char* hot_config =
+	"population_size: 100\n"
+	"tournament_size: 2\n"
+	"crossover_rate: 0.95\n"
+	"mutation_rate: 0.025\n"
+	"max_evaluations: 100000\n"
+	"selection_operator: tournament\n";
+
+/*!
+ * \brief read a handful of hot keywords repeatedly from several threads
+ * \return total reads per second across all threads
+ */
+double hot_key_reads(int nthreads, long reads_per_thread)
+{
+	vector<std::thread> threads;
+	bench_clock::time_point start = bench_clock::now();
+	for(int t=0; t<nthreads; t++) {
+		threads.push_back(std::thread([reads_per_thread]() {
+			int population = 0, tournament = 0;
+			double crossover = 0, mutation = 0;
+			for(long i=0; i<reads_per_thread; i+=4) {
+				kvparse::parameter_value("population_size", population);
+				kvparse::parameter_value("tournament_size", tournament);
+				kvparse::parameter_value("crossover_rate", crossover);
+				kvparse::parameter_value("mutation_rate", mutation);
+			}
+			if(population+tournament+crossover+mutation == 0) {
+				printf("unexpected values\n");
+			}
+		}));
+	}
+	for(unsigned int t=0; t<threads.size(); t++) {
+		threads[t].join();
+	}
+	return nthreads*reads_per_thread / seconds_since(start);
+}
+
+void bench_thread_cache()
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer(hot_config, "bench");
+
+	printf("thread_cache: hot keyword reads/sec (%u hardware threads)\n", std::thread::hardware_concurrency());
+	printf("%8s %16s %16s\n", "threads", "uncached", "cached");
+	for(int n=1; n<=64; n*=2) {
+		kvparse::set_thread_cache(false);
+		double uncached = hot_key_reads(n, 400000);
+		kvparse::set_thread_cache(true);
+		double cached = hot_key_reads(n, 400000);
+		printf("%8d %16.0f %16.0f\n", n, uncached, cached);
+	}
+	kvparse::set_thread_cache(false);
+	kvparse::clear();
+}
+
+/*!
+ * \brief format and write a large configuration, with and without a layout
+ */
+void bench_writer()
+{
+	const long entries = 1000000;
+	string text;
+	text.reserve(entries*32);
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i*7) + "  # note\n";
+	}
+	kvparse::clear();
+	kvparse::read_configuration_buffer(text, "bench");
+
+	printf("writer: %ld entries, %zu bytes\n", entries, text.size());
+	bench_clock::time_point start = bench_clock::now();
+	string plain = kvparse::format_configuration();
+	double t = seconds_since(start);
+	printf("%-24s %8.3f s %10.1f MB/s\n", "format (plain)", t, plain.size()/t/1e6);
+
+	start = bench_clock::now();
+	string laid_out = kvparse::format_configuration(text);
+	t = seconds_since(start);
+	printf("%-24s %8.3f s %10.1f MB/s\n", "format (layout)", t, laid_out.size()/t/1e6);
+
+	const char* filename = "bench_writer.cfg";
+	start = bench_clock::now();
+	kvparse::write_configuration_file(filename, false);
+	t = seconds_since(start);
+	printf("%-24s %8.3f s %10.1f MB/s\n", "write_configuration_file", t, plain.size()/t/1e6);
+	std::remove(filename);
+	kvparse::clear();
+}
+
+/*!
+ * \brief compare parsing a configuration with attaching to a published one
+ */
+void bench_shared()
+{
+	const long entries = 100000;
+	string text;
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i*7) + "\n";
+	}
+
+	printf("shared: %ld entries\n", entries);
+	kvparse::clear();
+	bench_clock::time_point start = bench_clock::now();
+	kvparse::read_configuration_buffer(text, "bench");
+	printf("%-24s %10.3f ms\n", "parse", seconds_since(start)*1e3);
+
+	start = bench_clock::now();
+	kvparse::publish_shared("kvparse-bench");
+	printf("%-24s %10.3f ms\n", "publish_shared", seconds_since(start)*1e3);
+
+	start = bench_clock::now();
+	{
+		kvparse_shared reader("kvparse-bench");
+		int value = 0;
+		reader.parameter_value("parameter_99999", value);
+		printf("%-24s %10.3f ms\n", "attach + first lookup", seconds_since(start)*1e3);
+
+		const long reads = 4000000;
+		start = bench_clock::now();
+		for(long i=0; i<reads; i++) {
+			reader.parameter_value("parameter_12345", value);
+		}
+		printf("%-24s %10.0f reads/sec\n", "shared lookups", reads/seconds_since(start));
+	}
+	kvparse::unpublish_shared("kvparse-bench");
+	kvparse::clear();
+}
+
+/*!
+ * \brief compare streaming a gzip file into the parser with decompressing
+ *        it to disk first and then parsing the result
+ */
+void bench_gzip()
+{
+	const long entries = 500000;
+	const char* plain_file = "bench_gzip.cfg";
+	const char* gzip_file = "bench_gzip.cfg.gz";
+	string text;
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i % 97) + " # generated\n";
+	}
+	gzFile out = gzopen(gzip_file, "wb");
+	gzwrite(out, text.data(), text.size());
+	gzclose(out);
+
+	printf("gzip: %ld entries, %.1f MB uncompressed\n", entries, text.size()/1e6);
+
+	kvparse::clear();
+	bench_clock::time_point start = bench_clock::now();
+	kvparse::read_configuration_file(gzip_file);
+	double streamed = seconds_since(start);
+
+	kvparse::clear();
+	start = bench_clock::now();
+	gzFile in = gzopen(gzip_file, "rb");
+	FILE* f = fopen(plain_file, "wb");
+	char block[65536];
+	int n;
+	while((n = gzread(in, block, sizeof(block))) > 0) {
+		fwrite(block, 1, n, f);
+	}
+	fclose(f);
+	gzclose(in);
+	kvparse::read_configuration_file(plain_file);
+	double staged = seconds_since(start);
+
+	kvparse::clear();
+	start = bench_clock::now();
+	kvparse::read_configuration_file(plain_file);
+	double parse_only = seconds_since(start);
+
+	printf("%-28s %8.3f s %10.1f MB/s\n", "streamed from .gz", streamed, text.size()/streamed/1e6);
+	printf("%-28s %8.3f s %10.1f MB/s\n", "decompress to disk + parse", staged, text.size()/staged/1e6);
+	printf("%-28s %8.3f s %10.1f MB/s\n", "parse uncompressed", parse_only, text.size()/parse_only/1e6);
+	std::remove(plain_file);
+	std::remove(gzip_file);
+	kvparse::clear();
+}
+
+/*!
+ * \brief show the load phase breakdown and what collecting it costs
+ */
+void bench_load_stats()
+{
+	const char* filename = "bench_load_stats.cfg";
+	FILE* f = fopen(filename, "w");
+	for(long i=0; i<300000; i++) {
+		fprintf(f, "  parameter_%ld = %ld   # generated\n", i, i % 97);
+	}
+	fclose(f);
+
+	kvparse::clear();
+	bench_clock::time_point start = bench_clock::now();
+	kvparse::read_configuration_file(filename);
+	double plain = seconds_since(start);
+
+	kvparse::clear();
+	kvparse::load_stats stats;
+	kvparse::read_configuration_file(filename, &stats);
+
+	printf("load_stats: %zu bytes, %zu lines, %zu entries, %zu allocations, longest line %zu\n",
+		   stats.bytes, stats.lines, stats.entries, stats.allocations, stats.longest_line);
+	printf("%-12s %8.3f s\n", "io", stats.io_seconds);
+	printf("%-12s %8.3f s\n", "comments", stats.comment_seconds);
+	printf("%-12s %8.3f s\n", "validate", stats.validate_seconds);
+	printf("%-12s %8.3f s\n", "trim", stats.trim_seconds);
+	printf("%-12s %8.3f s\n", "insert", stats.insert_seconds);
+	printf("%-12s %8.3f s (%.3f s without stats)\n", "total", stats.total_seconds, plain);
+	std::remove(filename);
+	kvparse::clear();
+}
+
+/*!
+ * \brief the first CPU of each online NUMA node, from sysfs
+ */
+vector<int> numa_node_cpus()
+{
+	vector<int> cpus;
+	for(int node=0; ; node++) {
+		std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		int cpu;
+		if(!(in >> cpu)) {
+			break;
+		}
+		cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+void pin_to_cpu(int cpu)
+{
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+/*!
+ * \brief snapshot lookups from one thread pinned to each NUMA node at once,
+ *        with a single frozen copy and with a copy per node
+ */
+void bench_numa()
+{
+	const long entries = 200000;
+	const long reads = 2000000;
+	string text;
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i*7) + "\n";
+	}
+	vector<string> keys;
+	for(long i=0; i<entries; i++) {
+		keys.push_back("parameter_" + std::to_string((i*7919) % entries));
+	}
+	vector<int> cpus = numa_node_cpus();
+	if(cpus.empty()) {
+		printf("numa: node layout not available\n");
+		return;
+	}
+
+	printf("numa: %ld entries, %zu nodes, one reader pinned to each\n", entries, cpus.size());
+	printf("%8s %16s %16s\n", "node", "single ns/read", "local ns/read");
+	vector<double> single(cpus.size()), local(cpus.size());
+	for(int replicas=0; replicas<2; replicas++) {
+		// the single copy is made on the first node
+		std::thread([&] {
+			pin_to_cpu(cpus[0]);
+			kvparse::clear();
+			kvparse::set_numa_replicas(replicas);
+			kvparse::read_configuration_buffer(text, "bench");
+			kvparse::snapshot();
+		}).join();
+
+		vector<std::thread> threads;
+		for(unsigned int n=0; n<cpus.size(); n++) {
+			threads.push_back(std::thread([&, n] {
+				pin_to_cpu(cpus[n]);
+				kvparse_snapshot snap = kvparse::snapshot();
+				long sum = 0;
+				bench_clock::time_point start = bench_clock::now();
+				for(long i=0; i<reads; i++) {
+					int value = 0;
+					snap.parameter_value(keys[i % entries], value);
+					sum += value;
+				}
+				(replicas ? local : single)[n] = seconds_since(start)*1e9/reads;
+				if(sum == 0) {
+					printf("unexpected values\n");
+				}
+			}));
+		}
+		for(unsigned int t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+	for(unsigned int n=0; n<cpus.size(); n++) {
+		printf("%8u %16.1f %16.1f\n", n, single[n], local[n]);
+	}
+	kvparse::set_numa_replicas(false);
+	kvparse::clear();
+}
+
+/*!
+ * \brief runtime writes per second from several threads, each to its own
+ *        keywords or all to one keyword, and reads alongside the writers
+ */
+void bench_runtime()
+{
+	const long writes = 200000;
+	kvparse::clear();
+	kvparse::read_configuration_buffer(hot_config, "bench");
+
+	printf("runtime: set_value calls/sec (%u hardware threads)\n", std::thread::hardware_concurrency());
+	printf("%8s %16s %16s %16s\n", "threads", "own keywords", "one keyword", "reads/sec");
+	for(int n=1; n<=16; n*=2) {
+		double rates[2];
+		for(int shared=0; shared<2; shared++) {
+			vector<std::thread> threads;
+			bench_clock::time_point start = bench_clock::now();
+			for(int t=0; t<n; t++) {
+				threads.push_back(std::thread([t, shared, writes]() {
+					vector<string> keys;
+					for(int k=0; k<64; k++) {
+						keys.push_back(shared ? string("contended") : "writer_" + std::to_string(t) + "_" + std::to_string(k));
+					}
+					for(long i=0; i<writes; i++) {
+						kvparse::set_value(keys[i % keys.size()], "1");
+					}
+				}));
+			}
+			for(unsigned int t=0; t<threads.size(); t++) {
+				threads[t].join();
+			}
+			rates[shared] = n*writes / seconds_since(start);
+		}
+
+		// readers of file values while the writers run
+		std::atomic<bool> done(false);
+		vector<std::thread> writers;
+		for(int t=0; t<n; t++) {
+			writers.push_back(std::thread([t, &done]() {
+				string key = "writer_" + std::to_string(t);
+				while(!done.load()) {
+					kvparse::set_value(key, "1");
+				}
+			}));
+		}
+		double reads = hot_key_reads(1, 400000);
+		done = true;
+		for(unsigned int t=0; t<writers.size(); t++) {
+			writers[t].join();
+		}
+		printf("%8d %16.0f %16.0f %16.0f\n", n, rates[0], rates[1], reads);
+	}
+	kvparse::clear();
+}
+
+/*!
+ * \brief runtime changes with and without the override log, and how long
+ *        replaying a large log takes
+ */
+void bench_override_log()
+{
+	const long changes = 1000000;
+	const char* filename = "bench_override.log";
+	vector<string> keys;
+	for(int k=0; k<1000; k++) {
+		keys.push_back("parameter_" + std::to_string(k));
+	}
+	std::remove(filename);
+
+	printf("override_log: %ld set_value calls over %zu keywords\n", changes, keys.size());
+	for(int logged=0; logged<2; logged++) {
+		kvparse::clear();
+		if(logged) {
+			kvparse::open_override_log(filename, (size_t)1 << 40);
+		}
+		bench_clock::time_point start = bench_clock::now();
+		for(long i=0; i<changes; i++) {
+			kvparse::set_value(keys[i % keys.size()], std::to_string(i));
+		}
+		kvparse::sync_override_log();
+		double t = seconds_since(start);
+		printf("%-24s %10.0f sets/sec\n", logged ? "logged" : "not logged", changes/t);
+	}
+	kvparse::clear();
+
+	bench_clock::time_point start = bench_clock::now();
+	kvparse::open_override_log(filename, (size_t)1 << 40);
+	printf("%-24s %10.3f ms\n", "replay", seconds_since(start)*1e3);
+	kvparse::clear();
+	std::remove(filename);
+}
+
+/*!
+ * \brief 50 keywords read one at a time and as one batch, from a database
+ *        too large to stay in cache between dispatches
+ */
+void bench_get_many()
+{
+	const long entries = 1000000;
+	const int per_dispatch = 50;
+	const long dispatches = 20000;
+	string text;
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+	}
+	kvparse::clear();
+	kvparse::read_configuration_buffer(text, "bench");
+	kvparse_snapshot snap = kvparse::snapshot();
+
+	// a different, scattered set of keywords for every dispatch
+	vector<string> names;
+	for(long d=0; d<dispatches; d++) {
+		for(int k=0; k<per_dispatch; k++) {
+			names.push_back("parameter_" + std::to_string((d*7919 + k*104729) % entries));
+		}
+	}
+	vector<string_view> keywords(names.begin(), names.end());
+	vector<std::expected<int,kv_error> > values(per_dispatch);
+
+	printf("get_many: %ld entries, %d keywords per dispatch\n", entries, per_dispatch);
+	long sum = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for(long d=0; d<dispatches; d++) {
+		for(int k=0; k<per_dispatch; k++) {
+			sum += *snap.try_get<int>(keywords[d*per_dispatch+k]);
+		}
+	}
+	double single = seconds_since(start)*1e9/dispatches;
+
+	start = bench_clock::now();
+	for(long d=0; d<dispatches; d++) {
+		snap.get_many<int>(std::span<const string_view>(keywords).subspan(d*per_dispatch, per_dispatch), values);
+		for(int k=0; k<per_dispatch; k++) {
+			sum -= *values[k];
+		}
+	}
+	double batched = seconds_since(start)*1e9/dispatches;
+	if(sum != 0) {
+		printf("unexpected values\n");
+	}
+	printf("%-24s %10.0f ns/dispatch\n", "try_get one at a time", single);
+	printf("%-24s %10.0f ns/dispatch\n", "get_many", batched);
+	kvparse::clear();
+}
+
+/*!
+ * \brief a runtime set_value before every batch of 50 keywords, read with
+ *        kvparse::get_many and with kvparse::try_get
+ */
+void bench_get_many_writes()
+{
+	const long entries = 1000000;
+	const int per_dispatch = 50;
+	const long dispatches = 2000;
+	string text;
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+	}
+	kvparse::clear();
+	kvparse::read_configuration_buffer(text, "bench");
+	kvparse::snapshot();
+
+	vector<string> names;
+	for(long d=0; d<dispatches; d++) {
+		for(int k=0; k<per_dispatch; k++) {
+			names.push_back("parameter_" + std::to_string((d*7919 + k*104729) % entries));
+		}
+	}
+	vector<string_view> keywords(names.begin(), names.end());
+	vector<std::expected<int,kv_error> > values(per_dispatch);
+
+	printf("get_many_writes: %ld entries, a set_value before each %d keywords\n", entries, per_dispatch);
+	long sum = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for(long d=0; d<dispatches; d++) {
+		kvparse::set_value("parameter_" + std::to_string(d), std::to_string(d));
+		for(int k=0; k<per_dispatch; k++) {
+			sum += *kvparse::try_get<int>(keywords[d*per_dispatch+k]);
+		}
+	}
+	double single = seconds_since(start)*1e9/dispatches;
+
+	start = bench_clock::now();
+	for(long d=0; d<dispatches; d++) {
+		kvparse::set_value("parameter_" + std::to_string(d), std::to_string(d));
+		kvparse::get_many<int>(std::span<const string_view>(keywords).subspan(d*per_dispatch, per_dispatch), values);
+		for(int k=0; k<per_dispatch; k++) {
+			sum -= *values[k];
+		}
+	}
+	double batched = seconds_since(start)*1e9/dispatches;
+	if(sum != 0) {
+		printf("unexpected values\n");
+	}
+	printf("%-24s %10.0f ns/dispatch\n", "set + try_get", single);
+	printf("%-24s %10.0f ns/dispatch\n", "set + get_many", batched);
+	kvparse::clear();
+}
+
+/*!
+ * \brief a hardware cache-miss counter for this thread, like one event of
+ *        perf stat, or nothing where the kernel or machine has none
+ */
+class miss_counter
+{
+public:
+	miss_counter(uint32_t type, uint64_t config) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	~miss_counter() {
+		if(fd_ >= 0) {
+			close(fd_);
+		}
+	}
+
+	bool available() const { return fd_ >= 0; }
+	void start() {
+		if(fd_ >= 0) {
+			ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+	//! misses since start(), or -1 if unavailable
+	double stop() {
+		uint64_t n = 0;
+		if(fd_ < 0 || ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0) != 0 || read(fd_, &n, sizeof(n)) != sizeof(n)) {
+			return -1;
+		}
+		return (double)n;
+	}
+
+private:
+	int fd_;
+};
+
+/*!
+ * \brief hot keywords scattered through a large database, read with and
+ *        without an access profile laying them out first
+ *
+ * Cache misses per lookup are counted with perf events where the machine
+ * has them; otherwise run the two halves under perf stat instead, e.g.,
+ * perf stat -e L1-dcache-load-misses,LLC-load-misses ./bench profiled_layout
+ */
+void bench_profiled_layout()
+{
+	const long entries = 1000000;
+	const long hot = 4096;
+	const long rounds = 200;
+	string text;
+	for(long i=0; i<entries; i++) {
+		text += "parameter_" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+	}
+	kvparse::clear();
+	kvparse::read_configuration_buffer(text, "bench");
+
+	vector<string> names;
+	for(long k=0; k<hot; k++) {
+		names.push_back("parameter_" + std::to_string((k*104729) % entries));
+	}
+
+	const char* filename = "bench_profiled_layout.cfg.profile";
+	miss_counter l1(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	miss_counter llc(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+	printf("profiled_layout: %ld entries, %ld hot keywords\n", entries, hot);
+	printf("%-24s %10s %14s %14s\n", "layout", "ns/lookup", "L1D miss/lkp", "LLC miss/lkp");
+	for(int profiled=0; profiled<2; profiled++) {
+		if(profiled) {
+			kvparse::set_access_profiling(true);
+			kvparse_snapshot snap = kvparse::snapshot();
+			for(long k=0; k<hot; k++) {
+				snap.try_get<int>(names[k]);
+			}
+			kvparse::set_access_profiling(false);
+			kvparse::write_access_profile(filename);
+			kvparse::read_access_profile(filename);
+		}
+		kvparse_snapshot snap = kvparse::snapshot();
+		long sum = 0;
+		for(long k=0; k<hot; k++) {
+			sum += *snap.try_get<int>(names[k]);
+		}
+
+		l1.start();
+		llc.start();
+		bench_clock::time_point start = bench_clock::now();
+		for(long r=0; r<rounds; r++) {
+			for(long k=0; k<hot; k++) {
+				sum -= *snap.try_get<int>(names[k]);
+			}
+		}
+		double elapsed = seconds_since(start);
+		double l1_misses = l1.stop();
+		double llc_misses = llc.stop();
+		if(sum == 1) {
+			printf("unexpected values\n");
+		}
+
+		double lookups = (double)rounds*hot;
+		printf("%-24s %10.1f", profiled ? "profile, hot keys first" : "keyword order", elapsed*1e9/lookups);
+		if(l1.available()) {
+			printf(" %14.2f", l1_misses/lookups);
+		} else {
+			printf(" %14s", "n/a");
+		}
+		if(llc.available()) {
+			printf(" %14.2f\n", llc_misses/lookups);
+		} else {
+			printf(" %14s\n", "n/a");
+		}
+	}
+	std::remove(filename);
+	kvparse::clear();
+}
+
+/*!
+ * \brief a symbolic value read as a string and compared name by name,
+ *        and read as an enum through its compiled name table
+ */
+void bench_enum()
+{
+	const long reads = 2000000;
+	kvparse::clear();
+	kvparse::read_configuration_buffer("replacement_operator: random\n", "bench");
+	kvparse_snapshot snap = kvparse::snapshot();
+
+	printf("enum: %ld reads of a value naming the last of 6 choices\n", reads);
+	long sum = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for(long i=0; i<reads; i++) {
+		string name;
+		snap.parameter_value("replacement_operator", name);
+		bench_replacement r;
+		if(name == "generational") {
+			r = bench_replacement::generational;
+		} else if(name == "steady_state") {
+			r = bench_replacement::steady_state;
+		} else if(name == "elitist") {
+			r = bench_replacement::elitist;
+		} else if(name == "crowding") {
+			r = bench_replacement::crowding;
+		} else if(name == "tournament") {
+			r = bench_replacement::tournament;
+		} else {
+			r = bench_replacement::random;
+		}
+		sum += (int)r;
+	}
+	double chain = seconds_since(start)*1e9/reads;
+
+	start = bench_clock::now();
+	for(long i=0; i<reads; i++) {
+		bench_replacement r = bench_replacement::generational;
+		snap.parameter_value("replacement_operator", r);
+		sum -= (int)r;
+	}
+	double table = seconds_since(start)*1e9/reads;
+	if(sum != 0) {
+		printf("unexpected values\n");
+	}
+	printf("%-24s %10.1f ns/read\n", "string and == chain", chain);
+	printf("%-24s %10.1f ns/read\n", "enum name table", table);
+	kvparse::clear();
+}
+
+struct benchmark
+{
+	const char* name;
+	void (*run)();
+};
+
+const benchmark benchmarks[] = {
+	{ "thread_cache", bench_thread_cache },
+	{ "writer", bench_writer },
+	{ "shared", bench_shared },
+	{ "gzip", bench_gzip },
+	{ "load_stats", bench_load_stats },
+	{ "numa", bench_numa },
+	{ "runtime", bench_runtime },
+	{ "override_log", bench_override_log },
+	{ "get_many", bench_get_many },
+	{ "get_many_writes", bench_get_many_writes },
+	{ "profiled_layout", bench_profiled_layout },
+	{ "enum", bench_enum },
+};
+
+}  // namespace
+
+
+// run the benchmarks named on the command line, or all of them
+int main(int argc, char **argv) {
+	for(unsigned int i=0; i<sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+		bool selected = (argc == 1);
+		for(int j=1; j<argc; j++) {
+			selected = selected || strcmp(argv[j], benchmarks[i].name) == 0;
+		}
+		if(selected) {
+			benchmarks[i].run();
+		}
+	}
+	return 0;
+}
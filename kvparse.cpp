@@ -14,7 +14,14 @@
 #include <map>
 #include <vector>
 #include <list>
+#include <deque>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+#include <condition_variable>
+#include <set>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -22,267 +29,3317 @@
 #include <cstring>
 #include <algorithm>
 #include <exception>
+#include <functional>
+#include <limits>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <chrono>
 #include <boost/regex.hpp>
-#include <boost/algorithm/string.hpp>
 #include "kvparse.h"
 #include "kvparse_except.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cerrno>
 
 using namespace std;
 
 //! stores the internal configuration data
-map<string,list<string> > kvparse::db_;
+kvparse::database kvparse::db_;
+
+//! counts changes to the internal configuration data
+atomic<uint64_t> kvparse::version_(0);
+atomic<uint64_t> kvparse::loaded_version_(0);
+
+//! enables the per-thread cache of converted values
+atomic<bool> kvparse::thread_cache_(false);
+atomic<bool> kvparse::numa_replicas_(false);
+atomic<bool> kvparse::access_profiling_(false);
+atomic<size_t> kvparse::runtime_count_(0);
+
+namespace
+{
+/*!
+ * \class intern_pool
+ *
+ * Holds exactly one immutable copy of each distinct keyword and value.
+ * Strings are packed end to end into large blocks that never move, so the
+ * views handed out stay valid until the pool is cleared, and two interned
+ * views are equal exactly when their data pointers are equal.
+ */
+class intern_pool
+{
+private:
+    static const size_t block_size = 4096;
+
+    std::pmr::memory_resource* resource_;
+    std::pmr::vector<pair<char*,size_t> > blocks_;
+    char* current_;
+    size_t used_;
+    std::pmr::unordered_set<string_view> index_;
+    kvparse::intern_stats stats_;
+
+    char* allocate_block(size_t size) {
+        char* block = static_cast<char*>(resource_->allocate(size, 1));
+        blocks_.push_back(make_pair(block, size));
+        return block;
+    }
+
+public:
+    intern_pool() :
+        resource_(std::pmr::get_default_resource()), blocks_(resource_), current_(0), used_(block_size),
+        index_(resource_), stats_() {}
+
+    ~intern_pool() {
+        clear();
+    }
+
+    //! return the shared copy of s, storing it on first sight
+    string_view intern(string_view s) {
+        stats_.references++;
+        stats_.bytes_referenced += s.size();
+
+        unordered_set<string_view>::const_iterator iter = index_.find(s);
+        if(iter != index_.end()) {
+            return *iter;
+        }
+
+        char* dest;
+        if(s.size() > block_size/4) {
+            // large strings get a block of their own so the current
+            // block can keep filling
+            dest = allocate_block(s.size());
+        } else {
+            if(used_+s.size() > block_size) {
+                current_ = allocate_block(block_size);
+                used_ = 0;
+            }
+            dest = current_+used_;
+            used_ += s.size();
+        }
+        memcpy(dest, s.data(), s.size());
+
+        string_view stored(dest, s.size());
+        index_.insert(stored);
+        stats_.unique++;
+        stats_.bytes_stored += s.size();
+        return stored;
+    }
+
+    //! return the shared copy of s if one exists, or an empty view otherwise
+    string_view find(string_view s) const {
+        unordered_set<string_view>::const_iterator iter = index_.find(s);
+        return iter == index_.end() ? string_view() : *iter;
+    }
+
+    const kvparse::intern_stats& stats() const {
+        return stats_;
+    }
+
+    size_t blocks() const {
+        return blocks_.size();
+    }
+
+    void clear() {
+        index_.clear();
+        for(size_t i=0; i<blocks_.size(); i++) {
+            resource_->deallocate(blocks_[i].first, blocks_[i].second, 1);
+        }
+        blocks_.clear();
+        current_ = 0;
+        used_ = block_size;
+        stats_ = kvparse::intern_stats();
+    }
+
+    //! clear the pool and take all future memory from the given resource
+    void reset(std::pmr::memory_resource* resource) {
+        clear();
+        resource_ = resource;
+        std::destroy_at(&blocks_);
+        std::construct_at(&blocks_, resource);
+        std::destroy_at(&index_);
+        std::construct_at(&index_, resource);
+    }
+};
+
+intern_pool pool;
+
+//! serializes insertion into the database between concurrent loads
+mutex load_mutex;
+
+/*!
+ * \brief a named source of configuration data for layered loading
+ */
+struct layer
+{
+    string name;
+    int precedence;
+    kvparse::database entries;
+
+    layer(const string& n, int p) : name(n), precedence(p), entries(kvparse::get_memory_resource()) {}
+};
+
+//! defined layers in increasing order of precedence; empty unless layering is in use
+vector<layer> layers;
+
+//! index into layers of the layer that supplied each keyword in the database
+map<string_view,size_t,less<> > provenance;
+
+//! name of the implicit lowest-precedence layer holding directly loaded files
+const char* const base_layer = "base";
+
+vector<layer>::iterator find_layer(const string& name)
+{
+    for(vector<layer>::iterator it=layers.begin(); it!=layers.end(); ++it) {
+        if(it->name == name) {
+            return it;
+        }
+    }
+    throw runtime_error("unknown configuration layer: " + name);
+}
+
+bool precedes(const layer& a, const layer& b)
+{
+    return a.precedence < b.precedence;
+}
+
+bool valid_keyword(string_view keyword)
+{
+    static const boost::regex re_identifier("^[A-Za-z_][A-Za-z0-9_.-]*'*");
+    return boost::regex_match(keyword.begin(), keyword.end(), re_identifier);
+}
+
+//! a runtime value must read back unchanged from a written configuration,
+//! so it may not start a comment or another line
+bool valid_runtime_value(string_view value)
+{
+    return !value.empty() && value.find_first_of("#\n\r") == string_view::npos;
+}
+
+//! guards the memoized ${...} expansions, which are filled in lazily by readers
+mutex interpolation_mutex;
+
+//! the expanded values of one keyword, which refer into its own copy of
+//! the text; readers share ownership, so a discarded expansion is freed
+//! once the last of them is done with it
+struct expansion
+{
+    std::list<string> text;
+    kvparse::value_list values;
+};
+
+//! expanded values of keywords whose values contain ${...} references
+map<string_view,shared_ptr<const expansion>,less<> > expansions;
+
+//! for each keyword, the keywords whose memoized expansions referred to it;
+//! keyed by copies, since a referenced keyword may exist only at run time
+map<string,set<string_view>,less<> > dependents;
+
+/*!
+ * \brief drop the memoized expansion of a keyword and of everything downstream of it
+ *
+ * The caller must hold interpolation_mutex.
+ */
+void invalidate_expansions(string_view keyword)
+{
+    vector<string_view> pending(1, keyword);
+    while(!pending.empty()) {
+        string_view k = pending.back();
+        pending.pop_back();
+        expansions.erase(k);
+
+        map<string,set<string_view>,less<> >::iterator iter = dependents.find(k);
+        if(iter != dependents.end()) {
+            pending.insert(pending.end(), iter->second.begin(), iter->second.end());
+            dependents.erase(iter);
+        }
+    }
+}
+
+//! the most recently frozen version of the database
+atomic<shared_ptr<const kvparse_frozen> > published;
+
+//! one stripe of the table of values set at run time
+struct alignas(64) runtime_shard
+{
+    shared_mutex lock;
+    map<string, shared_ptr<const vector<string> >, less<> > entries;
+};
+
+const size_t runtime_shard_count = 64;
+runtime_shard runtime_shards[runtime_shard_count];
+
+runtime_shard& shard_for(string_view keyword)
+{
+    return runtime_shards[hash<string_view>()(keyword) % runtime_shard_count];
+}
+
+//! one stripe of the per-keyword lookup counts of an access profile
+struct alignas(64) access_shard
+{
+    mutex lock;
+    map<string, uint64_t, less<> > counts;
+};
+
+access_shard access_shards[runtime_shard_count];
+
+//! keywords from the access profile, hottest first; guarded by load_mutex
+vector<string> hot_keywords;
+
+string_view trim(string_view token)
+{
+    string_view::size_type first_non_space = token.find_first_not_of(" \r\t");
+    if(first_non_space == string_view::npos) {
+        return string_view();
+    }
+    string_view::size_type last_non_space = token.find_last_not_of(" \r\t");
+    return token.substr(first_non_space, last_non_space-first_non_space+1);
+}
+
+//! true if a value opens a '[' that is closed on a later line
+bool opens_bracket(string_view value)
+{
+    return !value.empty() && value[0] == '[' && value.find(']') == string_view::npos;
+}
+
+/*!
+ * \brief add one line of a bracketed value to the text collected so far
+ * \param text the value so far, starting with '['
+ * \param line the next line, with any comment removed
+ * \return the position in line just past the closing ']', or npos
+ *
+ * Each line is one or more rows; lines are joined with "; " so the whole
+ * value is stored on a single line, e.g., "[0 1; 1 0]".
+ */
+string_view::size_type continue_bracket(string& text, string_view line)
+{
+    string_view::size_type close = line.find(']');
+    string_view row = trim(line.substr(0, close));
+    if(!row.empty()) {
+        if(text.size() > 1) {
+            text.append("; ");
+        }
+        text.append(row);
+    }
+    if(close == string_view::npos) {
+        return string_view::npos;
+    }
+    text.push_back(']');
+    return close+1;
+}
+
+/*!
+ * \brief read the whole of a configuration file into memory
+ */
+string read_file_contents(const string& filename)
+{
+    ifstream in(filename.c_str(), ios::in | ios::binary);
+    if(!in) {
+        throw runtime_error("failed to open configuration file: " + filename);
+    }
+    ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// compressed input is decompressed this many bytes at a time
+const size_t compressed_block_size = 64*1024;
+
+enum compression { uncompressed, gzip_compressed, zstd_compressed };
+
+//! identify compressed data by its magic bytes
+compression detect_compression(string_view head)
+{
+    if(head.size() >= 2 && (unsigned char)head[0] == 0x1f && (unsigned char)head[1] == 0x8b) {
+        return gzip_compressed;
+    }
+    if(head.size() >= 4 && head.substr(0, 4) == string_view("\x28\xb5\x2f\xfd", 4)) {
+        return zstd_compressed;
+    }
+    return uncompressed;
+}
+
+//! read up to size bytes; returns 0 at the end of the file
+size_t read_some(int fd, char* buf, size_t size, const string& filename)
+{
+    for(;;) {
+        ssize_t n = read(fd, buf, size);
+        if(n >= 0) {
+            return n;
+        }
+        if(errno != EINTR) {
+            throw runtime_error("failed to read configuration file: " + filename);
+        }
+    }
+}
+
+#ifndef KVPARSE_NO_LOAD_STATS
+// statistics requested by the load running on this thread, if any
+thread_local kvparse::load_stats* active_stats = 0;
+
+/*!
+ * \brief charges the time since the last lap to a phase of the active load
+ *
+ * Does nothing unless the thread's load asked for statistics, so the cost
+ * of an unprofiled load is one branch per phase.
+ */
+class phase_timer
+{
+private:
+    kvparse::load_stats* stats_;
+    chrono::steady_clock::time_point last_;
+
+public:
+    phase_timer() : stats_(active_stats) {
+        if(stats_) {
+            last_ = chrono::steady_clock::now();
+        }
+    }
+
+    kvparse::load_stats* stats() const { return stats_; }
+
+    void lap(double kvparse::load_stats::* phase) {
+        if(stats_) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            stats_->*phase += chrono::duration<double>(now-last_).count();
+            last_ = now;
+        }
+    }
+    //! restart without charging anyone, for time another timer accounts for
+    void skip() {
+        if(stats_) {
+            last_ = chrono::steady_clock::now();
+        }
+    }
+};
+#else
+class phase_timer
+{
+public:
+    kvparse::load_stats* stats() const { return 0; }
+    void lap(double kvparse::load_stats::*) {}
+    void skip() {}
+};
+#endif
+
+//! closes a file descriptor when it goes out of scope
+struct file_closer
+{
+    int fd;
+    ~file_closer() { close(fd); }
+};
+}
+
+/*!
+ * \brief erase all stored configuration data
+ *
+ * This includes the values set at run time, and the override log is
+ * closed after writing out what is queued for it: the changes stay in the
+ * file but are no longer applied or recorded. To reload the configuration
+ * and keep them, call open_override_log again after reading the files,
+ * which restores them and resumes recording. An access profile read
+ * with read_access_profile is kept.
+ */
+void kvparse::clear()
+{
+    lock_guard<mutex> load_lock(load_mutex);
+    db_.erase(db_.begin(), db_.end());
+    layers.clear();
+    provenance.clear();
+    {
+        lock_guard<mutex> lock(interpolation_mutex);
+        expansions.clear();
+        dependents.clear();
+    }
+    pool.clear();
+    close_override_log();
+    for(size_t i=0; i<runtime_shard_count; i++) {
+        unique_lock<shared_mutex> lock(runtime_shards[i].lock);
+        runtime_shards[i].entries.clear();
+    }
+    runtime_count_.store(0);
+    loaded_version_++;
+    version_++;
+}
+
+/*!
+ * \brief take all database memory from the given resource
+ * \param resource the resource to use, or null for the default resource
+ *
+ * The database is cleared first. From then on the keyword map, the value
+ * lists, the interned strings and the layers are all allocated from the
+ * resource, and clear() hands everything back to it. Snapshots and
+ * memoized interpolations are not included, since they can outlive a
+ * clear(). The resource must outlive its use by kvparse.
+ */
+void kvparse::set_memory_resource(std::pmr::memory_resource* resource)
+{
+    clear();
+    lock_guard<mutex> lock(load_mutex);
+    if(resource == 0) {
+        resource = std::pmr::get_default_resource();
+    }
+    std::destroy_at(&db_);
+    std::construct_at(&db_, resource);
+    pool.reset(resource);
+}
+
+/*!
+ * \brief the resource the database is currently allocated from
+ */
+std::pmr::memory_resource* kvparse::get_memory_resource()
+{
+    return db_.get_allocator().resource();
+}
+
+/*!
+ * \brief run a parse into the directly loaded part of the configuration
+ * \param parse the parse to run, given the database to fill
+ *
+ * Without layers that is the database itself. Once layers are in use it is
+ * the base layer, and the merged view is rebuilt afterwards, even if the
+ * parse fails partway through.
+ */
+bool kvparse::load_direct(const function<bool(database&)>& parse)
+{
+    lock_guard<mutex> lock(load_mutex);
+    if(layers.empty()) {
+        return parse(db_);
+    }
+
+    try {
+        parse(find_layer(base_layer)->entries);
+    } catch(...) {
+        merge_layers();
+        throw;
+    }
+    merge_layers();
+    return true;
+}
+
+/*!
+ * \brief rebuild the database from the configuration layers
+ *
+ * Layers are applied in increasing order of precedence. A keyword defined
+ * in a layer replaces all of the values given for it by lower layers.
+ * This runs whenever a layer changes, so lookups never have to consult
+ * more than the one merged database. The caller must hold load_mutex.
+ */
+void kvparse::merge_layers()
+{
+    database previous(db_.get_allocator());
+    previous.swap(db_);
+    provenance.clear();
+    for(size_t i=0; i<layers.size(); i++) {
+        database::const_iterator iter;
+        for(iter=layers[i].entries.begin(); iter!=layers[i].entries.end(); ++iter) {
+            db_[iter->first] = iter->second;
+            provenance[iter->first] = i;
+        }
+    }
+
+    // only expansions that depend on a keyword whose values actually
+    // changed need to be recomputed
+    lock_guard<mutex> lock(interpolation_mutex);
+    database::const_iterator iter;
+    for(iter=previous.begin(); iter!=previous.end(); ++iter) {
+        database::const_iterator now = db_.find(iter->first);
+        if(now == db_.end() || now->second != iter->second) {
+            invalidate_expansions(iter->first);
+        }
+    }
+    for(iter=db_.begin(); iter!=db_.end(); ++iter) {
+        if(previous.find(iter->first) == previous.end()) {
+            invalidate_expansions(iter->first);
+        }
+    }
+    loaded_version_++;
+    version_++;
+}
+
+/*!
+ * \brief create a configuration layer, or change an existing layer's precedence
+ * \param name the layer name
+ * \param precedence layers with higher precedence override lower ones
+ *
+ * Defining the first layer switches to layered loading. Anything already
+ * loaded, and anything loaded later through read_configuration_file and
+ * friends, goes into an implicit "base" layer below all others.
+ */
+void kvparse::define_layer(const string& name, int precedence)
+{
+    lock_guard<mutex> lock(load_mutex);
+    if(layers.empty()) {
+        layer base(base_layer, numeric_limits<int>::min());
+        base.entries.swap(db_);
+        layers.push_back(std::move(base));
+    }
+
+    vector<layer>::iterator it;
+    for(it=layers.begin(); it!=layers.end(); ++it) {
+        if(it->name == name) {
+            it->precedence = precedence;
+            break;
+        }
+    }
+    if(it == layers.end()) {
+        layers.push_back(layer(name, precedence));
+    }
+
+    stable_sort(layers.begin(), layers.end(), precedes);
+    merge_layers();
+}
+
+/*!
+ * \brief parse a configuration file into a layer
+ * \param layer_name a layer previously created with define_layer
+ * \param filename the name of the configuration file to parse
+ * \return true -- throws exception on errors
+ */
+bool kvparse::read_layer_file(const string& layer_name, const string& filename)
+{
+    string contents = read_file_contents(filename);
+    return read_layer_buffer(layer_name, contents, filename);
+}
+
+/*!
+ * \brief parse in-memory configuration text into a layer
+ * \param layer_name a layer previously created with define_layer
+ * \param buffer the configuration text, which is copied
+ * \param source_name the name reported in syntax errors
+ * \return true -- throws exception on errors
+ */
+bool kvparse::read_layer_buffer(const string& layer_name, string_view buffer, const string& source_name)
+{
+    return load_layer(layer_name, [&](database& db) {
+        return parse_buffer(db, buffer, source_name, false);
+    });
+}
+
+/*!
+ * \brief run a parse into a named layer
+ * \param layer_name a layer previously created with define_layer
+ * \param parse the parse to run, given the layer's database
+ *
+ * The merged view is rebuilt afterwards, even if the parse fails partway
+ * through.
+ */
+bool kvparse::load_layer(const string& layer_name, const function<bool(database&)>& parse)
+{
+    lock_guard<mutex> lock(load_mutex);
+    database& entries = find_layer(layer_name)->entries;
+    try {
+        parse(entries);
+    } catch(...) {
+        merge_layers();
+        throw;
+    }
+    merge_layers();
+    return true;
+}
+
+/*!
+ * \brief add environment variables carrying a given prefix to a layer
+ * \param layer_name a layer previously created with define_layer
+ * \param prefix only variables whose names begin with this are used
+ * \return the number of values added
+ *
+ * The prefix is stripped to form the keyword, and since environment
+ * variable names cannot contain dots, a double underscore stands for one,
+ * e.g., KV_mutation__rate sets mutation.rate.
+ */
+int kvparse::read_layer_environment(const string& layer_name, const string& prefix)
+{
+    lock_guard<mutex> lock(load_mutex);
+    database& entries = find_layer(layer_name)->entries;
+
+    int count = 0;
+    try {
+        for(char** env=environ; *env!=0; env++) {
+            string_view var(*env);
+            string_view::size_type eq = var.find('=');
+            if(eq == string_view::npos || var.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+
+            string keyword(var.substr(prefix.size(), eq-prefix.size()));
+            string::size_type pos;
+            while((pos = keyword.find("__")) != string::npos) {
+                keyword.replace(pos, 2, ".");
+            }
+            add_assignment(entries, keyword, var.substr(eq+1), "environment");
+            count++;
+        }
+    } catch(...) {
+        merge_layers();
+        throw;
+    }
+    merge_layers();
+    return count;
+}
+
+/*!
+ * \brief add command line arguments of the form --keyword=value to a layer
+ * \param layer_name a layer previously created with define_layer
+ * \param argc the argument count, as passed to main
+ * \param argv the arguments, as passed to main; argv[0] is skipped
+ * \return the number of values added
+ *
+ * Arguments not of that form are ignored, so the full command line can
+ * be passed in.
+ */
+int kvparse::read_layer_arguments(const string& layer_name, int argc, const char* const* argv)
+{
+    lock_guard<mutex> lock(load_mutex);
+    database& entries = find_layer(layer_name)->entries;
+
+    int count = 0;
+    try {
+        for(int i=1; i<argc; i++) {
+            string_view arg(argv[i]);
+            string_view::size_type eq = arg.find('=');
+            if(arg.compare(0, 2, "--") != 0 || eq == string_view::npos) {
+                continue;
+            }
+            add_assignment(entries, arg.substr(2, eq-2), arg.substr(eq+1), "command line");
+            count++;
+        }
+    } catch(...) {
+        merge_layers();
+        throw;
+    }
+    merge_layers();
+    return count;
+}
+
+/*!
+ * \brief discard everything loaded into a layer
+ * \param layer_name a layer previously created with define_layer
+ */
+void kvparse::clear_layer(const string& layer_name)
+{
+    lock_guard<mutex> lock(load_mutex);
+    find_layer(layer_name)->entries.clear();
+    merge_layers();
+}
+
+/*!
+ * \brief report which layer supplied a keyword's values
+ * \param keyword
+ * \return the layer name, or an empty string if the keyword does not
+ *         exist or layers are not in use
+ */
+string kvparse::source_layer(const string& keyword)
+{
+    lock_guard<mutex> lock(load_mutex);
+    map<string_view,size_t,less<> >::const_iterator iter = provenance.find(keyword);
+    if(iter == provenance.end()) {
+        return string();
+    }
+    return layers[iter->second].name;
+}
+
+/*!
+ * \brief add a single keyword/value pair that did not come from a file
+ * \param db the database to add to
+ * \param keyword the keyword, which must be a legal identifier
+ * \param value the value; surrounding whitespace is removed
+ * \param source description of where the pair came from, for errors
+ */
+void kvparse::add_assignment(database& db, string_view keyword, string_view value, const string& source)
+{
+    value = trim(value);
+    if(!valid_keyword(keyword) || value.empty()) {
+        throw syntax_error("syntax error in " + source + ": " + string(keyword) + "=" + string(value));
+    }
+    add_value(db, keyword, value);
+}
+
+/*!
+ * \brief parse a given configuration file
+ * \param filename the name of the configuration file to parse
+ * \return true -- throws exception on errors
+ */
+bool kvparse::read_configuration_file(const string& filename, load_stats* stats)
+{
+#ifndef KVPARSE_NO_LOAD_STATS
+    // collect into a local copy so that a failed load leaves stats alone
+    load_stats collected = load_stats();
+    struct activation
+    {
+        activation(load_stats* s) { active_stats = s; }
+        ~activation() { active_stats = 0; }
+    } activate(stats ? &collected : 0);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t blocks_before = pool.blocks();
+    size_t unique_before = pool.stats().unique;
+#endif
+    phase_timer timer;
+
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw runtime_error("failed to open configuration file: " + filename);
+    }
+    file_closer closer = { fd };
+
+    // the first block tells whether the file is compressed; if it is, the
+    // rest is decompressed as it is read rather than loaded whole
+    string contents(compressed_block_size, '\0');
+    contents.resize(read_some(fd, &contents[0], contents.size(), filename));
+    bool result;
+    if(detect_compression(contents) == gzip_compressed) {
+        if(timer.stats()) {
+            timer.stats()->bytes += contents.size();
+            timer.stats()->allocations++;
+        }
+        timer.lap(&load_stats::io_seconds);
+        result = load_direct([&](database& db) {
+            return parse_gzip(db, contents, fd, filename);
+        });
+    } else {
+        struct stat st;
+        size_t allocations = 1;
+        if(fstat(fd, &st) == 0 && st.st_size > (off_t)contents.size()) {
+            contents.reserve(st.st_size);
+            allocations++;
+        }
+        char block[compressed_block_size];
+        size_t n;
+        while((n = read_some(fd, block, sizeof(block), filename)) > 0) {
+            allocations += (contents.size()+n > contents.capacity());
+            contents.append(block, n);
+        }
+        if(timer.stats()) {
+            timer.stats()->bytes += contents.size();
+            timer.stats()->allocations += allocations;
+        }
+        timer.lap(&load_stats::io_seconds);
+        result = load_direct([&](database& db) {
+            return parse_buffer(db, contents, filename, false);
+        });
+    }
+
+#ifndef KVPARSE_NO_LOAD_STATS
+    if(stats) {
+        collected.allocations += (pool.blocks()-blocks_before) + (pool.stats().unique-unique_before);
+        collected.total_seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+        *stats = collected;
+    }
+#endif
+    return result;
+}
+
+/*!
+ * \brief parse configuration data held in memory
+ * \param buffer the configuration text
+ * \param source_name the name reported in syntax errors
+ * \param ownership whether the database may refer to the buffer directly
+ * \return true -- throws exception on errors
+ *
+ * With copy_buffer, keywords and values are interned just as they are when
+ * reading a file, and the buffer may be discarded as soon as this returns.
+ * With borrow_buffer, anything not already interned is referenced in place
+ * without copying; the caller must then keep the buffer alive and
+ * unchanged until the next call to clear().
+ */
+bool kvparse::read_configuration_buffer(string_view buffer, const string& source_name, buffer_ownership ownership)
+{
+    return load_direct([&](database& db) {
+        return parse_buffer(db, buffer, source_name, ownership == borrow_buffer);
+    });
+}
+
+/*!
+ * \brief parse configuration data from an input stream
+ * \param in the stream to read until end of file
+ * \param source_name the name reported in syntax errors
+ * \return true -- throws exception on errors
+ */
+bool kvparse::read_configuration_stream(istream& in, const string& source_name)
+{
+    return load_direct([&](database& db) {
+        return parse_stream(db, in, source_name);
+    });
+}
+
+/*!
+ * \brief parse a given configuration file on a background thread
+ * \param filename the name of the configuration file to parse
+ * \return a future that becomes ready once the file has been loaded
+ *
+ * The file is read on a worker thread without holding any lock; only the
+ * final insertion into the database is serialized with other loads. Any
+ * exception read_configuration_file would throw, including syntax_error,
+ * is rethrown from the future's get().
+ */
+future<bool> kvparse::read_configuration_file_async(const string& filename)
+{
+    return async(launch::async, [filename]() {
+        string contents = read_file_contents(filename);
+        return load_direct([&](database& db) {
+            return parse_buffer(db, contents, filename, false);
+        });
+    });
+}
+
+/*!
+ * \brief parse a batch of configuration files on background threads
+ * \param filenames the configuration files to parse
+ * \return a future that becomes ready once every file has been loaded
+ *
+ * All files are read concurrently, then parsed in the order given, so the
+ * result is the same as calling read_configuration_file on each in turn.
+ * The first error encountered is rethrown from the future's get(); files
+ * before it in the list will already have been loaded.
+ */
+future<bool> kvparse::read_configuration_files_async(const vector<string>& filenames)
+{
+    return async(launch::async, [filenames]() {
+        vector<future<string> > contents;
+        for(unsigned int i=0; i<filenames.size(); i++) {
+            contents.push_back(async(launch::async, read_file_contents, filenames[i]));
+        }
+        for(unsigned int i=0; i<contents.size(); i++) {
+            string text = contents[i].get();
+            load_direct([&](database& db) {
+                return parse_buffer(db, text, filenames[i], false);
+            });
+        }
+        return true;
+    });
+}
+
+/*!
+ * \brief parse configuration data from an input stream
+ * \param db the database to fill
+ * \param in the stream to read
+ * \param filename the name reported in syntax errors
+ * \return true -- throws exception on errors
+ *
+ * The caller must hold load_mutex.
+ */
+bool kvparse::parse_stream(database& db, istream& in, const string& filename)
+{
+    int lineno=0;
+    string line;
+    open_bracket open;
+    while(getline(in, line)) {
+        // update the line number
+        lineno++;
+        parse_line(db, line, filename, lineno, open);
+    }
+    check_closed(open, filename);
+    return true;
+}
+
+/*!
+ * \brief parse configuration data held in memory
+ * \param db the database to fill
+ * \param buffer the configuration text
+ * \param filename the name reported in syntax errors
+ * \param borrowed true if the database may refer to the buffer directly
+ * \return true -- throws exception on errors
+ *
+ * Lines are split off the buffer in place and handed to parse_line without
+ * being copied. The caller must hold load_mutex.
+ */
+bool kvparse::parse_buffer(database& db, string_view buffer, const string& filename, bool borrowed)
+{
+    switch(detect_compression(buffer)) {
+    case gzip_compressed:
+        return parse_gzip(db, buffer, -1, filename);
+    case zstd_compressed:
+        throw runtime_error("zstd-compressed configuration is not supported, decompress it first: " + filename);
+    case uncompressed:
+        break;
+    }
+
+    int lineno=0;
+    open_bracket open;
+    while(!buffer.empty()) {
+        lineno++;
+        string_view::size_type newline = buffer.find('\n');
+        parse_line(db, buffer.substr(0, newline), filename, lineno, open, borrowed);
+        if(newline == string_view::npos) {
+            break;
+        }
+        buffer.remove_prefix(newline+1);
+    }
+    check_closed(open, filename);
+    return true;
+}
+
+/*!
+ * \brief decompress gzip data and parse it as it is produced
+ * \param db the database to fill
+ * \param head the start of the compressed data (or all of it)
+ * \param fd where the rest of the compressed data is read from, or -1
+ * \param filename the name reported in errors
+ * \return true -- throws exception on errors
+ *
+ * Data is inflated one fixed-size block at a time and split into lines as
+ * each block arrives, so only a block of input, a block of output and any
+ * line straddling two blocks are held in memory. Concatenated gzip members
+ * are read one after another. The caller must hold load_mutex.
+ */
+bool kvparse::parse_gzip(database& db, string_view head, int fd, const string& filename)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, 15+16) != Z_OK) {
+        throw runtime_error("failed to initialize decompression for " + filename);
+    }
+    unique_ptr<char[]> in(new char[compressed_block_size]);
+    unique_ptr<char[]> out(new char[compressed_block_size]);
+    zs.next_in = (Bytef*)head.data();
+    zs.avail_in = head.size();
+
+    // fetch more compressed data once the current input is used up
+    phase_timer timer;
+    if(timer.stats()) {
+        timer.stats()->allocations += 2;
+    }
+    auto refill = [&]() {
+        if(zs.avail_in == 0 && fd >= 0) {
+            timer.skip();
+            zs.avail_in = read_some(fd, in.get(), compressed_block_size, filename);
+            zs.next_in = (Bytef*)in.get();
+            if(timer.stats()) {
+                timer.stats()->bytes += zs.avail_in;
+            }
+            timer.lap(&load_stats::io_seconds);
+        }
+        return zs.avail_in > 0;
+    };
+
+    string partial;
+    int lineno = 0;
+    open_bracket open;
+    try {
+        for(;;) {
+            if(!refill()) {
+                throw runtime_error("truncated compressed configuration file: " + filename);
+            }
+            zs.next_out = (Bytef*)out.get();
+            zs.avail_out = compressed_block_size;
+            timer.skip();
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                throw runtime_error("corrupt compressed configuration file: " + filename);
+            }
+            timer.lap(&load_stats::decompress_seconds);
+
+            const char* data = out.get();
+            const char* end = (const char*)zs.next_out;
+            while(data != end) {
+                const char* newline = (const char*)memchr(data, '\n', end-data);
+                if(newline == 0) {
+                    partial.append(data, end);
+                    break;
+                }
+                lineno++;
+                if(partial.empty()) {
+                    parse_line(db, string_view(data, newline-data), filename, lineno, open);
+                } else {
+                    partial.append(data, newline);
+                    parse_line(db, partial, filename, lineno, open);
+                    partial.clear();
+                }
+                data = newline+1;
+            }
+
+            if(ret == Z_STREAM_END) {
+                if(!refill()) {
+                    break;
+                }
+                inflateReset(&zs);
+            }
+        }
+        if(!partial.empty()) {
+            parse_line(db, partial, filename, ++lineno, open);
+        }
+        check_closed(open, filename);
+    } catch(...) {
+        inflateEnd(&zs);
+        throw;
+    }
+    inflateEnd(&zs);
+    return true;
+}
+
+/*!
+ * \brief parse a single line of configuration data
+ * \param db the database to fill
+ * \param line the line, without its terminating newline
+ * \param filename the name reported in syntax errors
+ * \param lineno the line number reported in syntax errors
+ * \param open a bracketed value carried over from earlier lines
+ * \param borrowed true if the database may refer to line directly
+ *
+ * The caller must hold load_mutex.
+ */
+void kvparse::parse_line(database& db, string_view line, const string& filename, int lineno,
+                         open_bracket& open, bool borrowed)
+{
+    static const boost::regex wsre("^[[:space:]]*$");
+
+    phase_timer timer;
+    if(timer.stats()) {
+        timer.stats()->lines++;
+        timer.stats()->longest_line = max(timer.stats()->longest_line, line.size());
+    }
+
+    // remove any comments
+    string_view::size_type hashpos = line.find('#');
+    if(hashpos != string_view::npos) {
+        line = line.substr(0, hashpos);
+    }
+    timer.lap(&load_stats::comment_seconds);
+
+    // rows of a bracketed value run up to the closing ']'
+    if(open.lineno != 0) {
+        string_view::size_type close = continue_bracket(open.text, line);
+        if(close == string_view::npos) {
+            return;
+        }
+        if(!trim(line.substr(close)).empty()) {
+            ostringstream mystr;
+            mystr << "syntax error in " << filename << " (" << lineno << "): "
+                  << line << endl;
+            throw syntax_error(mystr.str());
+        }
+        add_value(db, open.keyword, open.text);
+        open.lineno = 0;
+        if(timer.stats()) {
+            timer.stats()->entries++;
+        }
+        timer.lap(&load_stats::insert_seconds);
+        return;
+    }
+
+    // if the line is (now) blank, just go to the next line
+    if(boost::regex_match(line.begin(), line.end(), wsre)) {
+        timer.lap(&load_stats::validate_seconds);
+        return;
+    }
+
+    // parse the line into keyword and values
+    // first, find the delimiter
+    string_view::size_type delimiterpos = line.find(':');
+
+    // if there was no ":" delimiter, try an "="
+    if(delimiterpos == string_view::npos) {
+        delimiterpos = line.find('=');
+    }
+
+    // if still no delimiter, declare an error
+    if(delimiterpos == string_view::npos) {
+        ostringstream mystr;
+        mystr << "syntax error in " << filename << " (" << lineno <<  "): "
+              << line << endl;
+        throw syntax_error(mystr.str());
+    }
+    timer.lap(&load_stats::validate_seconds);
+
+	try {
+		// now we have the left hand side and right hand side
+		string_view thekeyword = line.substr(0, delimiterpos);
+		string_view thevalue   = line.substr(delimiterpos+1);
+		
+		// trim any leading or trailing spaces from the keyword; an empty
+		// token makes substr throw, which is reported as a syntax error
+		string_view::size_type first_non_space;
+		string_view::size_type last_non_space;
+		first_non_space = thekeyword.find_first_not_of(" \r\t");
+		last_non_space = thekeyword.find_last_not_of(" \r\t");
+		string_view::size_type tokenlen = last_non_space - first_non_space + 1;
+		thekeyword = thekeyword.substr(first_non_space, tokenlen);
+		timer.lap(&load_stats::trim_seconds);
+		
+		// make sure the keyword has no illegal characters
+		if(!valid_keyword(thekeyword)) {
+			throw syntax_error("syntax error");
+		}
+		timer.lap(&load_stats::validate_seconds);
+		
+		// trim any leading or trailing spaces from the value
+		first_non_space = thevalue.find_first_not_of(" \r\t");
+		last_non_space = thevalue.find_last_not_of(" \r\t");
+		tokenlen = last_non_space - first_non_space + 1;
+		thevalue = thevalue.substr(first_non_space, tokenlen);
+		timer.lap(&load_stats::trim_seconds);
+		
+		// a value that opens a '[' without closing it continues on the
+		// following lines
+		if(opens_bracket(thevalue)) {
+			open.keyword.assign(thekeyword);
+			open.text.assign(thevalue);
+			open.lineno = lineno;
+			return;
+		}
+
+		// add the mapping to the database
+		add_value(db, thekeyword, thevalue, borrowed);
+		if(timer.stats()) {
+			timer.stats()->entries++;
+		}
+		timer.lap(&load_stats::insert_seconds);
+	} catch(exception&) {
+		ostringstream mystr;
+		mystr << "syntax error in " << filename << " (" << lineno << "): "
+			  << line << endl;
+		throw syntax_error(mystr.str());
+	}
+}
+
+/*!
+ * \brief report a bracketed value still open at the end of the input
+ */
+void kvparse::check_closed(const open_bracket& open, const string& filename)
+{
+    if(open.lineno != 0) {
+        ostringstream mystr;
+        mystr << "syntax error in " << filename << " (" << open.lineno << "): "
+              << "no closing ']' for the value of " << open.keyword << endl;
+        throw syntax_error(mystr.str());
+    }
+}
+
+/*!
+ * \brief create a parser that accepts data in arbitrary chunks
+ * \param source_name the name reported in syntax errors
+ */
+kvparse_incremental_parser::kvparse_incremental_parser(const string& source_name) :
+    source_(source_name), open_(), lineno_(0)
+{
+}
+
+/*!
+ * \brief parse the next chunk of configuration data
+ * \param data the bytes to parse
+ * \param size the number of bytes
+ *
+ * Chunk boundaries may fall anywhere, including in the middle of a line.
+ * Every complete line in the chunk is parsed into the database at once;
+ * any trailing partial line is held back until the rest of it arrives or
+ * finish() is called.
+ */
+void kvparse_incremental_parser::feed(const char* data, size_t size)
+{
+    kvparse::load_direct([&](kvparse::database& db) {
+        const char* end = data+size;
+        while(data != end) {
+            const char* newline = (const char*)memchr(data, '\n', end-data);
+            if(newline == 0) {
+                partial_.append(data, end);
+                break;
+            }
+
+            lineno_++;
+            if(partial_.empty()) {
+                kvparse::parse_line(db, string_view(data, newline-data), source_, lineno_, open_);
+            } else {
+                partial_.append(data, newline);
+                kvparse::parse_line(db, partial_, source_, lineno_, open_);
+                partial_.clear();
+            }
+            data = newline+1;
+        }
+        return true;
+    });
+}
+
+/*!
+ * \brief parse any final line that was not terminated by a newline
+ * \return true -- throws exception on errors, including a '[' left open
+ *
+ * The parser may be reused for a new stream after finish() returns.
+ */
+bool kvparse_incremental_parser::finish()
+{
+    kvparse::open_bracket open;
+    string line;
+    line.swap(partial_);
+    swap(open, open_);
+    int lineno = lineno_;
+    lineno_ = 0;
+    if(!line.empty()) {
+        kvparse::load_direct([&](kvparse::database& db) {
+            kvparse::parse_line(db, line, source_, ++lineno, open);
+            return true;
+        });
+    }
+    kvparse::check_closed(open, source_);
+    return true;
+}
+
+/*!
+ * \brief add a new keyword/value pair
+ * \param db the database to add to
+ * \param keyword
+ * \param value
+ * 
+ * if keyword already exists, add the value onto the keyword's list
+ *
+ * Note that all values are stored as strings. Type conversion is done
+ * on requesting a value. Both the keyword and the value are interned, so
+ * repeated strings share a single stored copy. If borrowed is set, strings
+ * that have not been interned yet are stored as the views given, and the
+ * caller is responsible for keeping them alive.
+ */
+int kvparse::add_value(database& db, string_view keyword, string_view value, bool borrowed)
+{
+    string_view thekeyword;
+    string_view thevalue;
+    if(borrowed) {
+        thekeyword = pool.find(keyword);
+        thevalue = pool.find(value);
+        if(thekeyword.data() == 0) {
+            thekeyword = keyword;
+        }
+        if(thevalue.data() == 0) {
+            thevalue = value;
+        }
+    } else {
+        thekeyword = pool.intern(keyword);
+        thevalue = pool.intern(value);
+    }
+
+    if(&db == &db_) {
+        lock_guard<mutex> lock(interpolation_mutex);
+        invalidate_expansions(thekeyword);
+    }
+
+    pair<database::iterator,bool> slot = db.try_emplace(thekeyword);
+    value_list &valueList = slot.first->second;
+    valueList.push_back(thevalue);
+#ifndef KVPARSE_NO_LOAD_STATS
+    if(active_stats) {
+        active_stats->allocations += slot.second ? 2 : 1;
+    }
+#endif
+
+    // readers label what they cache with the version they saw beforehand,
+    // so the version must only move once the change is in place
+    if(&db == &db_) {
+        loaded_version_++;
+        version_++;
+    }
+    return (int)valueList.size();
+}
+
+/*!
+ * \brief the values set for a keyword at run time
+ * \return null if nothing was set for it at run time, or a list that is
+ *         empty if the keyword was removed
+ *
+ * Only the keyword's stripe is locked, and only for reading, so lookups
+ * wait for nothing but a writer replacing the same stripe's entry.
+ */
+shared_ptr<const kvparse::runtime_values> kvparse::runtime_lookup(string_view keyword)
+{
+    runtime_shard& shard = shard_for(keyword);
+    shared_lock<shared_mutex> lock(shard.lock);
+    map<string, shared_ptr<const runtime_values>, less<> >::const_iterator iter = shard.entries.find(keyword);
+    return iter == shard.entries.end() ? shared_ptr<const runtime_values>() : iter->second;
+}
+
+/*!
+ * \brief the values a keyword was loaded with, with ${...} references expanded
+ * \return null if the keyword was not loaded
+ *
+ * Must not be called with a stripe held: expanding references takes the
+ * stripes of the keywords referred to while holding interpolation_mutex.
+ */
+shared_ptr<const kvparse::runtime_values> kvparse::loaded_values(string_view keyword)
+{
+    kv_errc err;
+    value_hold hold;
+    const value_list* values = lookup(keyword, &err, &hold);
+    if(values == 0) {
+        return shared_ptr<const runtime_values>();
+    }
+    return make_shared<const runtime_values>(values->begin(), values->end());
+}
+
+/*!
+ * \brief the values a keyword has now
+ * \param keyword
+ * \param loaded the keyword's loaded values, from loaded_values
+ * \return null if the keyword does not exist
+ *
+ * The caller must hold the keyword's stripe for writing.
+ */
+shared_ptr<const kvparse::runtime_values> kvparse::current_values(string_view keyword,
+                                                                  const shared_ptr<const runtime_values>& loaded)
+{
+    runtime_shard& shard = shard_for(keyword);
+    map<string, shared_ptr<const runtime_values>, less<> >::const_iterator iter = shard.entries.find(keyword);
+    if(iter != shard.entries.end()) {
+        return iter->second->empty() ? shared_ptr<const runtime_values>() : iter->second;
+    }
+    return loaded;
+}
+
+/*!
+ * \brief the values a keyword was given at run time, as a value list
+ * \param keyword
+ * \param values set to the list, or to null if the keyword was removed
+ * \param hold set to keep the list alive while it is read
+ * \return false if the keyword has not been changed at run time
+ */
+bool kvparse::runtime_list(string_view keyword, const value_list** values, value_hold* hold)
+{
+    struct held_list
+    {
+        shared_ptr<const runtime_values> text;
+        value_list values;
+    };
+
+    shared_ptr<const runtime_values> changed = runtime_lookup(keyword);
+    if(!changed) {
+        return false;
+    }
+    if(changed->empty()) {
+        *values = 0;
+        return true;
+    }
+    shared_ptr<held_list> held = make_shared<held_list>();
+    held->values.assign(changed->begin(), changed->end());
+    held->text = std::move(changed);
+    *values = &held->values;
+    *hold = std::move(held);
+    return true;
+}
+
+/*!
+ * \brief list the keywords with a given prefix as readers see them
+ * \param prefix the keyword prefix, or empty for every keyword
+ * \param entries filled in keyword order; a keyword removed at run time
+ *        is left out
+ * \param storage keeps the values of keywords changed at run time alive
+ *
+ * Loaded values are referred to in place, unexpanded; values set at run
+ * time replace them, the same way freeze() applies them. The runtime
+ * table is copied one stripe at a time, so writers are only paused
+ * briefly.
+ */
+void kvparse::effective_values(string_view prefix, vector<effective_entry>& entries, effective_storage& storage)
+{
+    map<string_view, shared_ptr<const runtime_values>, less<> > overrides;
+    if(runtime_count_.load() != 0) {
+        for(size_t i=0; i<runtime_shard_count; i++) {
+            shared_lock<shared_mutex> lock(runtime_shards[i].lock);
+            map<string, shared_ptr<const runtime_values>, less<> >::const_iterator o;
+            for(o=runtime_shards[i].entries.lower_bound(prefix); o!=runtime_shards[i].entries.end(); ++o) {
+                if(!o->first.starts_with(prefix)) {
+                    break;
+                }
+                overrides.insert(*o);
+            }
+        }
+    }
+
+    database::const_iterator iter = db_.lower_bound(prefix);
+    map<string_view, shared_ptr<const runtime_values>, less<> >::const_iterator o = overrides.begin();
+    for(;;) {
+        bool loaded = iter != db_.end() && iter->first.starts_with(prefix);
+        if(!loaded && o == overrides.end()) {
+            break;
+        }
+        if(o != overrides.end() && (!loaded || o->first <= iter->first)) {
+            if(loaded && o->first == iter->first) {
+                ++iter;
+            }
+            if(!o->second->empty()) {
+                storage.held.push_back(o->second);
+                storage.lists.emplace_back(o->second->begin(), o->second->end());
+                effective_entry e = { o->first, &storage.lists.back(), true };
+                entries.push_back(e);
+            }
+            ++o;
+        } else {
+            effective_entry e = { iter->first, &iter->second, false };
+            entries.push_back(e);
+            ++iter;
+        }
+    }
+}
+
+namespace {
+
+/*!
+ * \brief sync the directory holding a file, so a rename into it is durable
+ * \return false if the directory could not be opened or synced
+ */
+bool sync_directory(const string& filename)
+{
+    string::size_type slash = filename.rfind('/');
+    string dir = slash == string::npos ? string(".") : filename.substr(0, slash == 0 ? 1 : slash);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/*!
+ * \brief an append-only file of runtime changes, synced in batches
+ *
+ * Each record holds a keyword and the complete list of values it has
+ * after the change, so replaying the file only needs the last record for
+ * each keyword:
+ *
+ *     u32 keyword size, keyword, u32 value count,
+ *     value count x { u32 size, bytes }
+ *
+ * in host byte order, where a value count of zero means the keyword was
+ * removed. Writers only append records to a buffer in memory. A
+ * background thread writes the buffer out as one frame,
+ *
+ *     u32 size, size bytes of records, u32 crc32 of the records
+ *
+ * and syncs it, so every change that arrives while one sync is in
+ * progress is made durable by the next, and a frame cut short by a crash
+ * is recognized and dropped as a whole. The same thread rewrites the file
+ * with one record per keyword once it has grown past a threshold.
+ */
+class override_log
+{
+public:
+    override_log(const string& filename, int fd, size_t file_bytes, size_t compact_bytes)
+        : filename_(filename), fd_(fd), file_bytes_(file_bytes), compacted_bytes_(0),
+          compact_bytes_(compact_bytes), appended_(0), durable_(0), stopping_(false), failed_(false) {
+        flusher_ = std::thread([this] { flush_loop(); });
+    }
+
+    ~override_log() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        flusher_.join();
+        close(fd_);
+    }
+
+    //! queue the record of a change; the caller holds the keyword's stripe
+    void append(string_view keyword, const vector<string>& values) {
+        lock_guard<mutex> lock(mutex_);
+        size_t before = pending_.size();
+        encode(pending_, keyword, values);
+        appended_ += pending_.size()-before;
+        // the flusher only sleeps while there is nothing to write
+        if(before == 0) {
+            wake_.notify_one();
+        }
+    }
+
+    //! wait until every change queued so far is on disk
+    void sync() {
+        unique_lock<mutex> lock(mutex_);
+        uint64_t target = appended_;
+        synced_.wait(lock, [&] { return durable_ >= target || failed_; });
+        if(failed_) {
+            throw runtime_error("failed to write override log: " + filename_);
+        }
+    }
+
+    static void encode(string& out, string_view keyword, const vector<string>& values) {
+        put<uint32_t>(out, keyword.size());
+        out.append(keyword);
+        put<uint32_t>(out, values.size());
+        for(unsigned int i=0; i<values.size(); i++) {
+            put<uint32_t>(out, values[i].size());
+            out.append(values[i]);
+        }
+    }
+
+    /*!
+     * \brief find the last record for each keyword
+     * \param text the file contents
+     * \param last filled with each keyword's values from its last record
+     * \return the length of the intact prefix; anything after it is a
+     *         frame cut short by a crash, or damaged
+     */
+    static size_t scan(string_view text, unordered_map<string_view,vector<string_view> >& last) {
+        size_t used = 0;
+        for(;;) {
+            string_view rest = text.substr(used);
+            uint32_t size, crc;
+            if(rest.size() < sizeof(size)) {
+                return used;
+            }
+            memcpy(&size, rest.data(), sizeof(size));
+            if(rest.size()-sizeof(size) < (size_t)size+sizeof(crc)) {
+                return used;
+            }
+            string_view records = rest.substr(sizeof(size), size);
+            memcpy(&crc, records.data()+size, sizeof(crc));
+            if(crc != crc32(0, reinterpret_cast<const Bytef*>(records.data()), size)) {
+                return used;
+            }
+            while(!records.empty()) {
+                string_view keyword;
+                uint32_t count;
+                if(!take_bytes<uint32_t>(records, keyword) || !take(records, count) || count > records.size()) {
+                    return used;
+                }
+                vector<string_view>& values = last[keyword];
+                values.resize(count);
+                for(unsigned int i=0; i<count; i++) {
+                    if(!take_bytes<uint32_t>(records, values[i])) {
+                        return used;
+                    }
+                }
+            }
+            used += sizeof(size)+size+sizeof(crc);
+        }
+    }
+
+private:
+    string filename_;
+    int fd_;
+    size_t file_bytes_;
+    size_t compacted_bytes_;
+    size_t compact_bytes_;
+
+    mutex mutex_;
+    condition_variable wake_;
+    condition_variable synced_;
+    string pending_;
+    uint64_t appended_;   // bytes of records ever queued
+    uint64_t durable_;    // bytes of those known to be on disk
+    bool stopping_;
+    bool failed_;
+    std::thread flusher_;
+
+    template <typename T>
+    static void put(string& out, T x) {
+        out.append(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+
+    template <typename T>
+    static bool take(string_view& in, T& x) {
+        if(in.size() < sizeof(x)) {
+            return false;
+        }
+        memcpy(&x, in.data(), sizeof(x));
+        in.remove_prefix(sizeof(x));
+        return true;
+    }
+
+    template <typename Size>
+    static bool take_bytes(string_view& in, string_view& bytes) {
+        Size n;
+        if(!take(in, n) || in.size() < n) {
+            return false;
+        }
+        bytes = in.substr(0, n);
+        in.remove_prefix(n);
+        return true;
+    }
+
+    //! write records as one frame; returns the bytes written, or 0 on failure
+    static size_t write_frame(int fd, string_view records) {
+        if(records.empty()) {
+            return 0;
+        }
+        uint32_t size = records.size();
+        uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(records.data()), size);
+        string frame;
+        frame.reserve(sizeof(size)+size+sizeof(crc));
+        put<uint32_t>(frame, size);
+        frame.append(records);
+        put<uint32_t>(frame, crc);
+
+        string_view data(frame);
+        while(!data.empty()) {
+            ssize_t n = write(fd, data.data(), data.size());
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n < 0) {
+                return 0;
+            }
+            data.remove_prefix(n);
+        }
+        return frame.size();
+    }
+
+    //! write a frame and sync it; false on failure
+    bool commit(int fd, string_view records, size_t& file_bytes) {
+        size_t n = write_frame(fd, records);
+        if(n == 0 && !records.empty()) {
+            return false;
+        }
+        file_bytes += n;
+        return fdatasync(fd) == 0;
+    }
+
+    void flush_loop() {
+        unique_lock<mutex> lock(mutex_);
+        for(;;) {
+            wake_.wait(lock, [&] { return stopping_ || !pending_.empty(); });
+            if(pending_.empty()) {
+                break;
+            }
+            string batch;
+            batch.swap(pending_);
+            uint64_t upto = appended_;
+            lock.unlock();
+
+            bool ok = commit(fd_, batch, file_bytes_);
+
+            lock.lock();
+            failed_ = failed_ || !ok;
+            durable_ = upto;
+            synced_.notify_all();
+
+            // changes made during a compaction are appended to the new
+            // file, which can leave it due for another one
+            while(!failed_ && file_bytes_ > compact_bytes_ && file_bytes_ > 2*compacted_bytes_) {
+                lock.unlock();
+                compact();
+                lock.lock();
+            }
+        }
+    }
+
+    /*!
+     * \brief rewrite the file with only the current values of each keyword
+     *
+     * The state is captured with every stripe held for reading, which
+     * pauses writers but not readers, and only long enough to copy the
+     * reference-counted value lists. The new file is written and synced
+     * under a temporary name while writers carry on, then the changes
+     * queued since the capture are added to it and it is renamed over the
+     * old one and the directory synced, so a crash at any point leaves one
+     * complete log.
+     */
+    void compact() {
+        vector<pair<string, shared_ptr<const vector<string> > > > state;
+        string before;
+        uint64_t captured;
+        {
+            vector<shared_lock<shared_mutex> > stripes;
+            for(size_t i=0; i<runtime_shard_count; i++) {
+                stripes.push_back(shared_lock<shared_mutex>(runtime_shards[i].lock));
+                state.insert(state.end(), runtime_shards[i].entries.begin(), runtime_shards[i].entries.end());
+            }
+            lock_guard<mutex> lock(mutex_);
+            before.swap(pending_);
+            captured = appended_;
+        }
+
+        // everything up to the capture must be in the old file first
+        bool ok = commit(fd_, before, file_bytes_);
+
+        string text;
+        for(unsigned int i=0; i<state.size(); i++) {
+            encode(text, state[i].first, *state[i].second);
+        }
+        string tmpname = filename_ + ".compact";
+        int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        size_t state_bytes = (ok && fd >= 0) ? write_frame(fd, text) : 0;
+        size_t new_bytes = state_bytes;
+        ok = ok && fd >= 0 && (state_bytes > 0 || text.empty());
+
+        string after;
+        uint64_t upto;
+        {
+            lock_guard<mutex> lock(mutex_);
+            after.swap(pending_);
+            upto = appended_;
+        }
+        if(ok && commit(fd, after, new_bytes) && rename(tmpname.c_str(), filename_.c_str()) == 0) {
+            close(fd_);
+            fd_ = fd;
+            file_bytes_ = new_bytes;
+            compacted_bytes_ = state_bytes;
+            // until the directory is synced, a crash could bring back the
+            // old file, without the records that went only into the new one
+            ok = sync_directory(filename_);
+        } else {
+            // keep appending to the old file, which is still complete
+            if(fd >= 0) {
+                close(fd);
+                unlink(tmpname.c_str());
+            }
+            ok = commit(fd_, after, file_bytes_);
+            compacted_bytes_ = file_bytes_;
+        }
+
+        lock_guard<mutex> lock(mutex_);
+        failed_ = failed_ || !ok;
+        durable_ = std::max(durable_, ok ? upto : captured);
+        synced_.notify_all();
+    }
+};
+
+// the open override log, if any; writers use it while holding a stripe
+atomic<override_log*> active_log(0);
+
+//! replace a keyword's runtime entry; the caller holds the stripe for writing
+void store_runtime(runtime_shard& shard, string_view keyword, shared_ptr<const vector<string> > values,
+                   atomic<size_t>& count)
+{
+    if(override_log* log = active_log.load(memory_order_acquire)) {
+        log->append(keyword, *values);
+    }
+    map<string, shared_ptr<const vector<string> >, less<> >::iterator iter = shard.entries.find(keyword);
+    if(iter == shard.entries.end()) {
+        shard.entries.emplace(string(keyword), std::move(values));
+        count.fetch_add(1, memory_order_release);
+    } else {
+        iter->second = std::move(values);
+    }
+}
+
+/*!
+ * \brief discard the memoized expansions that referred to a keyword changed at run time
+ * \return true if any loaded value refers to the keyword
+ *
+ * Call it after releasing the keyword's stripe: expand takes stripes
+ * while holding interpolation_mutex, so the opposite order could deadlock.
+ */
+bool forget_expansions(string_view keyword)
+{
+    lock_guard<mutex> lock(interpolation_mutex);
+    bool referred = dependents.find(keyword) != dependents.end();
+    invalidate_expansions(keyword);
+    return referred;
+}
+
+}  // namespace
+
+/*!
+ * \brief give a keyword a single value, replacing whatever it had
+ * \param keyword
+ * \param value
+ *
+ * Values set at run time take precedence over every file and layer, are
+ * kept until clear(), and are taken literally, without ${...} expansion.
+ * Any number of threads may set, append and remove values concurrently
+ * with each other and with lookups: the table is split into independently
+ * locked stripes by keyword hash, so writers to different keywords rarely
+ * meet. Throws syntax_error if the keyword is not valid, or if the value
+ * is empty or contains '#' or a line break, which would not read back.
+ */
+void kvparse::set_value(const string& keyword, const string& value)
+{
+    string_view v = trim(value);
+    if(!valid_keyword(keyword) || !valid_runtime_value(v)) {
+        throw syntax_error("syntax error in runtime value: " + keyword + "=" + value);
+    }
+    shared_ptr<const runtime_values> values = make_shared<const runtime_values>(1, string(v));
+    runtime_shard& shard = shard_for(keyword);
+    {
+        unique_lock<shared_mutex> lock(shard.lock);
+        store_runtime(shard, keyword, std::move(values), runtime_count_);
+    }
+    if(forget_expansions(keyword)) {
+        loaded_version_++;
+    }
+    version_++;
+    publish_change(keyword);
+}
+
+/*!
+ * \brief add a value to those a keyword already has
+ * \param keyword
+ * \param value
+ * \return the number of values the keyword now has
+ *
+ * The keyword's current values, from files or from earlier runtime
+ * changes, are kept ahead of the new one. See set_value.
+ */
+int kvparse::append_value(const string& keyword, const string& value)
+{
+    string_view v = trim(value);
+    if(!valid_keyword(keyword) || !valid_runtime_value(v)) {
+        throw syntax_error("syntax error in runtime value: " + keyword + "=" + value);
+    }
+    runtime_shard& shard = shard_for(keyword);
+    shared_ptr<const runtime_values> loaded = loaded_values(keyword);
+    size_t count;
+    {
+        unique_lock<shared_mutex> lock(shard.lock);
+        shared_ptr<const runtime_values> current = current_values(keyword, loaded);
+        shared_ptr<runtime_values> values = current ? make_shared<runtime_values>(*current)
+                                                    : make_shared<runtime_values>();
+        values->push_back(string(v));
+        count = values->size();
+        store_runtime(shard, keyword, std::move(values), runtime_count_);
+    }
+    if(forget_expansions(keyword)) {
+        loaded_version_++;
+    }
+    version_++;
+    publish_change(keyword);
+    return (int)count;
+}
+
+/*!
+ * \brief remove a given keyword/value pair
+ * \param keyword
+ * \param value
+ * \return the number of values the keyword has left; 0 if it had no such
+ *         value, or has none left
+ *
+ * If the keyword does not have the value, nothing changes. If removing
+ * the value leaves none, the keyword no longer exists. See set_value.
+ */
+int kvparse::remove_value(const string& keyword, const string& value)
+{
+    runtime_shard& shard = shard_for(keyword);
+    shared_ptr<const runtime_values> loaded = loaded_values(keyword);
+    size_t count;
+    {
+        unique_lock<shared_mutex> lock(shard.lock);
+        shared_ptr<const runtime_values> current = current_values(keyword, loaded);
+        if(!current) {
+            return 0;
+        }
+        runtime_values::const_iterator iter = find(current->begin(), current->end(), value);
+        if(iter == current->end()) {
+            return 0;
+        }
+        shared_ptr<runtime_values> values = make_shared<runtime_values>(*current);
+        values->erase(values->begin()+(iter-current->begin()));
+        count = values->size();
+        store_runtime(shard, keyword, std::move(values), runtime_count_);
+    }
+    if(forget_expansions(keyword)) {
+        loaded_version_++;
+    }
+    version_++;
+    publish_change(keyword);
+    return (int)count;
+}
+
+/*!
+ * \brief record runtime changes in a file and restore those already in it
+ * \param filename the log file, created if it does not exist
+ * \param compact_bytes rewrite the log once it grows past this size
+ * \return the number of keywords restored from the log
+ *
+ * The changes in the log are applied on top of whatever has been loaded,
+ * so open the log after reading the configuration files. From then on,
+ * every set_value, append_value and remove_value is appended to it. The
+ * calls only queue the record; a background thread writes and syncs the
+ * queue in batches, so a crash can lose the last few milliseconds of
+ * changes. Use sync_override_log to wait for them. A record cut short by
+ * a crash is dropped when the log is next opened. Throws runtime_error if
+ * the file cannot be read or opened for writing.
+ */
+size_t kvparse::open_override_log(const string& filename, size_t compact_bytes)
+{
+    close_override_log();
+
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        throw runtime_error("failed to open override log: " + filename);
+    }
+    // mapped rather than read, since most of a long log is superseded
+    // records that are only skipped over
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        throw runtime_error("failed to read override log: " + filename);
+    }
+    void* mapped = 0;
+    if(st.st_size > 0) {
+        mapped = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("failed to read override log: " + filename);
+        }
+    }
+    string_view text(static_cast<const char*>(mapped), mapped ? st.st_size : 0);
+    struct unmapper
+    {
+        void* addr;
+        size_t size;
+        ~unmapper() { if(addr) munmap(addr, size); }
+    } unmap = { mapped, text.size() };
+
+    unordered_map<string_view,vector<string_view> > last;
+    size_t intact = override_log::scan(text, last);
+    if((intact < text.size() && ftruncate(fd, intact) != 0) || lseek(fd, intact, SEEK_SET) < 0) {
+        close(fd);
+        throw runtime_error("failed to open override log: " + filename);
+    }
+    for(const pair<const string_view,vector<string_view> >& record : last) {
+        shared_ptr<const runtime_values> values = make_shared<const runtime_values>(record.second.begin(), record.second.end());
+        runtime_shard& shard = shard_for(record.first);
+        {
+            unique_lock<shared_mutex> lock(shard.lock);
+            store_runtime(shard, record.first, std::move(values), runtime_count_);
+        }
+        if(forget_expansions(record.first)) {
+            loaded_version_++;
+        }
+    }
+    if(!last.empty()) {
+        version_++;
+        if(shared_ptr<const kvparse_frozen> current = published.load()) {
+            publish(current->base_ ? current->base_ : current);
+        }
+    }
+
+    active_log.store(new override_log(filename, fd, intact, compact_bytes), memory_order_release);
+    return last.size();
+}
+
+/*!
+ * \brief wait until every runtime change made so far is on disk
+ *
+ * Does nothing if no override log is open. Throws runtime_error if
+ * writing the log has failed.
+ */
+void kvparse::sync_override_log()
+{
+    if(override_log* log = active_log.load(memory_order_acquire)) {
+        log->sync();
+    }
+}
+
+/*!
+ * \brief write out any queued changes and stop logging
+ *
+ * Changes made afterwards are not recorded. The runtime values themselves
+ * are kept. Also done by clear(), which discards the runtime values as
+ * well; reopen the log after reloading to restore them.
+ */
+void kvparse::close_override_log()
+{
+    override_log* log = active_log.exchange(0);
+    if(log == 0) {
+        return;
+    }
+    // writers use the log while holding their stripe, so once every
+    // stripe has been taken nobody can still be appending to it
+    for(size_t i=0; i<runtime_shard_count; i++) {
+        unique_lock<shared_mutex> lock(runtime_shards[i].lock);
+    }
+    delete log;
+}
+
+/*!
+ * \brief check to see if a keyword is in the database
+ * \param keyword
+ * \return true if the keyword exists in the database, false otherwise
+ */
+bool kvparse::keyword_exists(const string &keyword)
+{
+    if(runtime_count_.load(memory_order_acquire) != 0) {
+        shared_ptr<const runtime_values> set = runtime_lookup(keyword);
+        if(set) {
+            return !set->empty();
+        }
+    }
+    database::const_iterator iter;
+    iter=db_.find(keyword);
+    if(iter==db_.end()) {
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief check to see if a keyword is mapped to a single unique value
+ * \param keyword
+ * \return true if the keyword exists and has a single specified value; false otherwise
+ */
+bool kvparse::has_unique_value(const string &keyword)
+{
+    if(runtime_count_.load(memory_order_acquire) != 0) {
+        shared_ptr<const runtime_values> set = runtime_lookup(keyword);
+        if(set) {
+            return set->size() == 1;
+        }
+    }
+    if(!keyword_exists(keyword)) {
+		return false;
+	}
+	
+    database::const_iterator iter;
+    iter=db_.find(keyword);
+
+    const value_list &valueList=(*iter).second;
+    if(valueList.size()!=1) {
+        return false;
+    }
+
+    return true;  
+}
+
+/*!
+ * \brief return the values of a keyword with ${...} references expanded
+ * \param iter the keyword's entry in the database
+ * \param err set to the reason if the expansion fails
+ * \return the expanded values, or null if a reference could not be resolved
+ *
+ * Each ${name} is replaced by the single value of keyword name, which may
+ * itself contain references. Expansions are computed on first use and
+ * memoized until a keyword they depend on changes. A reference to a
+ * missing or multi-valued keyword, an unterminated reference, or a cycle
+ * of references makes the expansion fail.
+ *
+ * Expanded text is held by the memo itself, not the intern pool, so
+ * readers never modify the pool that loads fill under load_mutex, and a
+ * discarded expansion is freed once its last reader lets go of it.
+ */
+const kvparse::value_list* kvparse::interpolate(database::const_iterator iter, kv_errc* err, value_hold* hold)
+{
+    lock_guard<mutex> lock(interpolation_mutex);
+    vector<string_view> in_progress;
+    const value_list* values = expand(iter, in_progress, err);
+    if(values != 0) {
+        *hold = expansions.find(iter->first)->second;
+    }
+    return values;
+}
+
+/*!
+ * \brief expand one keyword's values, recursing into the keywords it refers to
+ * \param iter the keyword's entry in the database
+ * \param in_progress the chain of keywords currently being expanded
+ * \param err set to the reason if the expansion fails
+ *
+ * The caller must hold interpolation_mutex.
+ */
+const kvparse::value_list* kvparse::expand(database::const_iterator iter, vector<string_view>& in_progress,
+                                         kv_errc* err)
+{
+    map<string_view,shared_ptr<const expansion>,less<> >::const_iterator memo = expansions.find(iter->first);
+    if(memo != expansions.end()) {
+        return &memo->second->values;
+    }
+    if(find(in_progress.begin(), in_progress.end(), iter->first) != in_progress.end()) {
+        *err = kv_errc::cyclic_reference;
+        return 0;
+    }
+    in_progress.push_back(iter->first);
+
+    shared_ptr<expansion> expanded = make_shared<expansion>();
+    for(value_list::const_iterator v=iter->second.begin(); v!=iter->second.end(); ++v) {
+        string result;
+        string_view text = *v;
+        string_view::size_type start;
+        while((start = text.find("${")) != string_view::npos) {
+            string_view::size_type end = text.find('}', start+2);
+            if(end == string_view::npos) {
+                *err = kv_errc::unresolved_reference;
+                return 0;
+            }
+
+            // recorded before resolving, so that a keyword appearing later,
+            // at run time, can still invalidate a failed expansion
+            string_view name = text.substr(start+2, end-start-2);
+            dependents[string(name)].insert(iter->first);
+            string_view replacement;
+            shared_ptr<const runtime_values> changed;
+            if(runtime_count_.load(memory_order_acquire) != 0) {
+                changed = runtime_lookup(name);
+            }
+            if(changed) {
+                // values set at run time are taken literally
+                if(changed->size() != 1) {
+                    *err = kv_errc::unresolved_reference;
+                    return 0;
+                }
+                replacement = changed->front();
+            } else {
+                database::const_iterator target = db_.find(name);
+                if(target == db_.end() || target->second.size() != 1) {
+                    *err = kv_errc::unresolved_reference;
+                    return 0;
+                }
+                replacement = target->second.front();
+                if(replacement.find("${") != string_view::npos) {
+                    const value_list* expanded_target = expand(target, in_progress, err);
+                    if(expanded_target == 0) {
+                        return 0;
+                    }
+                    replacement = expanded_target->front();
+                }
+            }
+
+            result.append(text.substr(0, start));
+            result.append(replacement);
+            text.remove_prefix(end+1);
+        }
+        result.append(text);
+        expanded->text.push_back(std::move(result));
+        expanded->values.push_back(expanded->text.back());
+    }
+
+    in_progress.pop_back();
+    expansions[iter->first] = expanded;
+    return &expanded->values;
+}
+
+/*!
+ * \brief display the contents of the configuration database
+ */
+void kvparse::dump_contents(ostream &ostr)
+{
+    vector<effective_entry> entries;
+    effective_storage storage;
+    effective_values(string_view(), entries, storage);
+    for(unsigned int i=0; i<entries.size(); i++) {
+        ostr << "Keyword: " << entries[i].keyword << "  |  ";
+        const value_list &values=*entries[i].values;
+        value_list::const_iterator valueIter;
+        ostr << "Values: ";
+        for(valueIter=values.begin(); valueIter!=values.end(); valueIter++) {
+            ostr << *valueIter << " ";
+        }
+        ostr << '\n';
+    }
+    ostr.flush();
+}
+
+/*!
+ * \brief render the database as configuration file text
+ * \param layout the text of an earlier version of the file, or empty
+ * \return text that reads back into the current database
+ *
+ * Without a layout, every value is written as "keyword: value" in keyword
+ * order. With one, the layout is followed line by line: comments, blank
+ * lines and entries whose value is unchanged are copied exactly; entries
+ * whose value changed keep their indentation, delimiter and trailing
+ * comment around the new value; entries that no longer exist are dropped.
+ * Values that are not in the layout are appended at the end. Repeated
+ * keywords are matched occurrence by occurrence.
+ *
+ * Values are written as stored, so ${...} references are preserved.
+ * Values set at run time are written in place of the loaded ones.
+ */
+string kvparse::format_configuration(string_view layout)
+{
+    lock_guard<mutex> lock(load_mutex);
+
+    vector<effective_entry> entries;
+    effective_storage storage;
+    effective_values(string_view(), entries, storage);
+
+    size_t bytes = layout.size();
+    vector<effective_entry>::const_iterator iter;
+    for(iter=entries.begin(); iter!=entries.end(); ++iter) {
+        for(value_list::const_iterator v=iter->values->begin(); v!=iter->values->end(); ++v) {
+            bytes += iter->keyword.size() + v->size() + 3;
+        }
+    }
+    string out;
+    out.reserve(bytes+1);
+
+    // how many of each keyword's values the layout has accounted for
+    map<string_view,size_t,less<> > written;
+
+    while(!layout.empty()) {
+        string_view::size_type newline = layout.find('\n');
+        string_view line = layout.substr(0, newline == string_view::npos ? layout.size() : newline+1);
+        layout.remove_prefix(line.size());
+
+        string_view content = line.substr(0, line.find_first_of("#\n"));
+        string_view::size_type delimiterpos = content.find(':');
+        if(delimiterpos == string_view::npos) {
+            delimiterpos = content.find('=');
+        }
+        string_view thekeyword = trim(content.substr(0, delimiterpos == string_view::npos ? 0 : delimiterpos));
+        if(thekeyword.empty()) {
+            // comments, blank lines and anything else that is not an entry
+            out.append(line);
+            continue;
+        }
+
+        // take in the rest of the rows of a bracketed value first, so
+        // they go with the entry whether it is kept, changed or dropped;
+        // the value is stored joined into one line
+        string_view thevalue = trim(content.substr(delimiterpos+1));
+        bool bracketed = opens_bracket(thevalue);
+        string joined;
+        if(bracketed) {
+            joined = thevalue;
+            while(!layout.empty()) {
+                newline = layout.find('\n');
+                string_view row = layout.substr(0, newline == string_view::npos ? layout.size() : newline+1);
+                layout.remove_prefix(row.size());
+                line = string_view(line.data(), line.size()+row.size());
+                if(continue_bracket(joined, row.substr(0, row.find_first_of("#\n"))) != string_view::npos) {
+                    break;
+                }
+            }
+        }
+
+        iter = lower_bound(entries.begin(), entries.end(), thekeyword,
+                           [](const effective_entry& e, string_view k) { return e.keyword < k; });
+        if(iter == entries.end() || iter->keyword != thekeyword) {
+            continue;
+        }
+        size_t& n = written[iter->keyword];
+        if(n >= iter->values->size()) {
+            continue;
+        }
+        value_list::const_iterator v = iter->values->begin();
+        advance(v, n++);
+
+        if(bracketed) {
+            // written back joined into one line if it changed
+            if(joined == *v) {
+                out.append(line);
+            } else {
+                out.append(line.substr(0, thevalue.data()-line.data()));
+                out.append(*v);
+                out.push_back('\n');
+            }
+        } else if(thevalue == *v) {
+            out.append(line);
+        } else {
+            // splice the new value into the old line
+            string_view::size_type value_start = thevalue.empty() ? content.size() : thevalue.data()-line.data();
+            out.append(line.substr(0, value_start));
+            if(thevalue.empty() && (value_start == 0 || line[value_start-1] != ' ')) {
+                out.push_back(' ');
+            }
+            out.append(*v);
+            out.append(line.substr(value_start+thevalue.size()));
+        }
+    }
+
+    if(!out.empty() && out[out.size()-1] != '\n') {
+        out.push_back('\n');
+    }
+    for(iter=entries.begin(); iter!=entries.end(); ++iter) {
+        map<string_view,size_t,less<> >::const_iterator done = written.find(iter->keyword);
+        value_list::const_iterator v = iter->values->begin();
+        if(done != written.end()) {
+            advance(v, done->second);
+        }
+        for(; v!=iter->values->end(); ++v) {
+            out.append(iter->keyword);
+            out.append(": ");
+            out.append(*v);
+            out.push_back('\n');
+        }
+    }
+    return out;
+}
+
+/*!
+ * \brief write the database out as a configuration file
+ * \param filename the file to write
+ * \param preserve_layout if the file already exists, keep its comments,
+ *        ordering and formatting for entries that did not change
+ * \return true -- throws exception on errors
+ *
+ * The whole file is assembled in memory and written to a temporary file
+ * with a single write, which is then renamed over the target, so readers
+ * never see a partially written configuration.
+ */
+bool kvparse::write_configuration_file(const string& filename, bool preserve_layout)
+{
+    string layout;
+    if(preserve_layout && access(filename.c_str(), F_OK) == 0) {
+        layout = read_file_contents(filename);
+    }
+    string text = format_configuration(layout);
+
+    string tmpname = filename + ".tmp";
+    int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw runtime_error("failed to open configuration file for writing: " + tmpname);
+    }
+    const char* data = text.data();
+    size_t remaining = text.size();
+    while(remaining > 0) {
+        ssize_t n = write(fd, data, remaining);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            close(fd);
+            unlink(tmpname.c_str());
+            throw runtime_error("failed to write configuration file: " + tmpname);
+        }
+        data += n;
+        remaining -= n;
+    }
+    if(close(fd) != 0 || rename(tmpname.c_str(), filename.c_str()) != 0) {
+        unlink(tmpname.c_str());
+        throw runtime_error("failed to write configuration file: " + filename);
+    }
+    return true;
+}
+
+/*!
+ * \brief report how much storage interning has saved
+ * \return counters covering everything added since the last clear()
+ */
+kvparse::intern_stats kvparse::interning_stats()
+{
+    return pool.stats();
+}
+
+/*!
+ * \brief return the number of changes made to the database so far
+ *
+ * Every load, layer change and clear() increases the version, so two equal
+ * readings mean the database did not change in between.
+ */
+uint64_t kvparse::version()
+{
+    return version_.load();
+}
+
+/*!
+ * \brief turn the per-thread cache of converted values on or off
+ *
+ * With the cache on, scalar lookups remember their converted result in a
+ * small per-thread table, so a thread that keeps reading the same few
+ * keywords skips the map search and conversion until the database changes.
+ */
+void kvparse::set_thread_cache(bool enabled)
+{
+    thread_cache_.store(enabled);
+}
+
+/*!
+ * \brief pin the current version of the database for consistent reads
+ * \return a handle serving lookups from an immutable copy of that version
+ *
+ * The loaded values are copied at most once per load, by the first
+ * snapshot taken after it. Runtime changes do not invalidate that copy:
+ * each one publishes a new overlay of the changed keywords over it, so
+ * after them, as after any other call, taking a snapshot only loads the
+ * published version and increments its reference count. The exception is
+ * a runtime change to a keyword that loaded values refer to with ${...},
+ * which makes the next snapshot copy the loaded values again. With NUMA
+ * replicas enabled, the handle refers to the copy on the node the calling
+ * thread is running on.
+ */
+kvparse_snapshot kvparse::snapshot()
+{
+    return kvparse_snapshot(node_local(current_frozen()));
+}
+
+/*!
+ * \brief the copy of a frozen version on the calling thread's NUMA node
+ * \return frozen itself if it has no replicas or the node is unknown
+ */
+shared_ptr<const kvparse_frozen> kvparse::node_local(const shared_ptr<const kvparse_frozen>& frozen)
+{
+    if(!frozen->replicas_.empty()) {
+        unsigned int cpu, node;
+        if(getcpu(&cpu, &node) == 0 && node < frozen->replicas_.size() && frozen->replicas_[node]) {
+            return frozen->replicas_[node];
+        }
+    }
+    return frozen;
+}
+
+namespace {
+
+//! parse a sysfs list such as "0-3,8-11" into the numbers it names
+vector<int> parse_cpu_list(const string& text)
+{
+    vector<int> ids;
+    istringstream in(text);
+    string range;
+    while(getline(in, range, ',')) {
+        int first, last;
+        char dash;
+        istringstream r(range);
+        if(!(r >> first)) {
+            continue;
+        }
+        last = (r >> dash >> last) ? last : first;
+        for(int id=first; id<=last; id++) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
 
 /*!
- * \brief erase all stored configuration data
+ * \brief the CPUs of each online NUMA node, indexed by node number
+ *
+ * Read once from sysfs; empty if the kernel does not report nodes.
  */
-void kvparse::clear()
+const vector<vector<int> >& numa_cpus()
 {
-    db_.erase(db_.begin(), db_.end());
+    static const vector<vector<int> > nodes = [] {
+        vector<vector<int> > nodes;
+        ifstream online("/sys/devices/system/node/online");
+        string text;
+        if(!getline(online, text)) {
+            return nodes;
+        }
+        vector<int> ids = parse_cpu_list(text);
+        for(unsigned int i=0; i<ids.size(); i++) {
+            ifstream cpulist("/sys/devices/system/node/node"+to_string(ids[i])+"/cpulist");
+            string cpus;
+            if(getline(cpulist, cpus)) {
+                nodes.resize(std::max<size_t>(nodes.size(), ids[i]+1));
+                nodes[ids[i]] = parse_cpu_list(cpus);
+            }
+        }
+        return nodes;
+    }();
+    return nodes;
 }
 
 /*!
- * \brief parse a given configuration file
- * \param filename the name of the configuration file to parse
- * \return true -- throws exception on errors
+ * \brief a thread bound to one NUMA node's CPUs that runs the jobs given to it
+ *
+ * Memory a job touches first is allocated on the worker's node. Workers
+ * are started the first time their node needs a copy and kept for the
+ * life of the process, so freezing neither creates nor binds threads.
  */
-bool kvparse::read_configuration_file(const string& filename)
+class node_worker
 {
-    ifstream in(filename.c_str());
-    if(!in) {
-        throw runtime_error("failed to open configuration file: " + filename);
+public:
+    explicit node_worker(const vector<int>& cpus) : thread_([this, cpus] { run(cpus); }) {}
+
+    ~node_worker() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
     }
 
-    int lineno=0;
-    string line;
-    while(!getline(in, line).eof()) {
-        // update the line number
-        lineno++;
-		
-        // remove any comments
-        int hashpos = (int)line.find("#", 0);
-        if(hashpos != (int)string::npos) {
-            line = line.erase(hashpos);
+    //! queue a job; the future reports its completion or its exception
+    future<void> submit(function<void()> job) {
+        packaged_task<void()> task(std::move(job));
+        future<void> done = task.get_future();
+        {
+            lock_guard<mutex> lock(mutex_);
+            jobs_.push_back(std::move(task));
         }
+        wake_.notify_one();
+        return done;
+    }
 
-        // if the line is (now) blank, just go to the next line
-		boost::regex wsre("^[[:space:]]*$");
-		if(boost::regex_match(line, wsre)) {
-            continue;
-		}
-		
-        // parse the line into keyword and values
-        // first, find the delimiter
-        int delimiterpos = (int)line.find(":", 0);
+private:
+    /*!
+     * \brief bind to the node's CPUs, then run jobs until stopped
+     *
+     * The CPU set is sized for the highest CPU id, which may be beyond
+     * CPU_SETSIZE on large machines. If binding fails, jobs still run,
+     * wherever the kernel schedules them.
+     */
+    void run(const vector<int>& cpus) {
+        int highest = cpus.empty() ? 0 : *max_element(cpus.begin(), cpus.end());
+        if(cpu_set_t* mask = CPU_ALLOC(highest+1)) {
+            size_t size = CPU_ALLOC_SIZE(highest+1);
+            CPU_ZERO_S(size, mask);
+            for(unsigned int i=0; i<cpus.size(); i++) {
+                CPU_SET_S(cpus[i], size, mask);
+            }
+            pthread_setaffinity_np(pthread_self(), size, mask);
+            CPU_FREE(mask);
+        }
 
-        // if there was no ":" delimiter, try an "="
-        if(delimiterpos == (int)string::npos) {
-            delimiterpos = (int)line.find("=", 0);
+        unique_lock<mutex> lock(mutex_);
+        for(;;) {
+            wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if(jobs_.empty()) {
+                return;
+            }
+            packaged_task<void()> task = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
         }
+    }
 
-        // if still no delimiter, declare an error
-        if(delimiterpos == (int)string::npos) {
-            ostringstream mystr;
-            mystr << "syntax error in " << filename << " (" << lineno <<  "): "
-                  << line << endl;
-            throw syntax_error(mystr.str());
+    mutex mutex_;
+    condition_variable wake_;
+    deque<packaged_task<void()> > jobs_;
+    bool stopping_ = false;
+    std::thread thread_;  // last, so it starts after the rest is constructed
+};
+
+/*!
+ * \brief the worker for a NUMA node, started on first use
+ *
+ * The caller must hold load_mutex.
+ */
+node_worker& worker_for(size_t node, const vector<int>& cpus)
+{
+    static vector<unique_ptr<node_worker> > workers;
+    if(workers.size() <= node) {
+        workers.resize(node+1);
+    }
+    if(!workers[node]) {
+        workers[node].reset(new node_worker(cpus));
+    }
+    return *workers[node];
+}
+
+}  // namespace
+
+/*!
+ * \brief keep a frozen copy of the database on every NUMA node
+ * \param enabled whether snapshots should come from node-local copies
+ *
+ * When enabled, each time the database is frozen it is also copied once
+ * per node by a long-lived thread bound to that node's CPUs, so the
+ * kernel's first-touch policy places the copy in that node's memory. The
+ * nodes' copies are made at the same time. snapshot()
+ * then hands each thread the copy for the node it is running on, as
+ * reported by getcpu. No NUMA library is needed; if the node layout
+ * cannot be read, snapshots are served from the single frozen copy as
+ * before.
+ */
+void kvparse::set_numa_replicas(bool enabled)
+{
+    lock_guard<mutex> lock(load_mutex);
+    numa_replicas_.store(enabled);
+    loaded_version_++;
+}
+
+/*!
+ * \brief count lookups per keyword, for writing an access profile
+ * \param enabled true to start counting afresh, false to stop counting
+ *
+ * Counts are kept after counting stops, so they can still be written out.
+ */
+void kvparse::set_access_profiling(bool enabled)
+{
+    if(enabled) {
+        for(size_t i=0; i<runtime_shard_count; i++) {
+            lock_guard<mutex> lock(access_shards[i].lock);
+            access_shards[i].counts.clear();
         }
+    }
+    access_profiling_.store(enabled);
+}
 
-		try {
-			// now we have the left hand side and right hand side
-			string thekeyword = line.substr(0, delimiterpos);
-			string thevalue   = line.substr(delimiterpos+1);
-			
-			// trim any leading or trailing spaces from the keyword
-			int first_non_space;
-			int last_non_space;
-			first_non_space = (int)thekeyword.find_first_not_of(" \r\t");
-			last_non_space = (int)thekeyword.find_last_not_of(" \r\t");
-			int tokenlen = last_non_space - first_non_space + 1;
-			thekeyword = thekeyword.substr(first_non_space, tokenlen);
-			
-			// make sure the keyword has no illegal characters
-			boost::regex re_identifier("^[A-Za-z_][A-Za-z0-9_.-]*'*");
-			if(!boost::regex_match(thekeyword, re_identifier)) {
-				throw syntax_error("syntax error");
-			}
-			
-			// trim any leading or trailing spaces from the value
-			first_non_space = (int)thevalue.find_first_not_of(" \r\t");
-			last_non_space = (int)thevalue.find_last_not_of(" \r\t");
-			tokenlen = last_non_space - first_non_space + 1;
-			thevalue = thevalue.substr(first_non_space, tokenlen);
-			
-			// add the mapping to the database
-			add_value(thekeyword, thevalue);
-		} catch(exception&) {
-			ostringstream mystr;
-			mystr << "syntax error in " << filename << " (" << lineno << "): "
-				  << line << endl;
-			throw syntax_error(mystr.str());
-		}
+void kvparse::record_access(string_view keyword)
+{
+    access_shard& shard = access_shards[hash<string_view>()(keyword) % runtime_shard_count];
+    lock_guard<mutex> lock(shard.lock);
+    map<string, uint64_t, less<> >::iterator iter = shard.counts.find(keyword);
+    if(iter == shard.counts.end()) {
+        iter = shard.counts.emplace(string(keyword), 0).first;
     }
-    return true;
+    iter->second++;
 }
 
 /*!
- * \brief add a new keyword/value pair
- * \param keyword
- * \param value
- * 
- * if keyword already exists, add the value onto the keyword's list
+ * \brief the lookups counted per keyword, most looked-up first
+ */
+vector<pair<string,uint64_t> > kvparse::access_profile()
+{
+    vector<pair<string,uint64_t> > profile;
+    for(size_t i=0; i<runtime_shard_count; i++) {
+        lock_guard<mutex> lock(access_shards[i].lock);
+        profile.insert(profile.end(), access_shards[i].counts.begin(), access_shards[i].counts.end());
+    }
+    sort(profile.begin(), profile.end(), [](const pair<string,uint64_t>& a, const pair<string,uint64_t>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return profile;
+}
+
+/*!
+ * \brief save the access profile, one "count keyword" line per keyword
+ * \param fileName where to write it, e.g., the configuration file's name
+ *        with ".profile" appended
  *
- * Note that all values are stored as strings. Type conversion is done
- * on requesting a value.
+ * The file is written under a temporary name and renamed into place, so a
+ * reader never sees it half written.
  */
-int kvparse::add_value(const string &keyword, const string &value)
+void kvparse::write_access_profile(const string& fileName)
 {
-    if(!keyword_exists(keyword)) {
-        list<string> valueList;
-        valueList.push_back(value);
-        db_[keyword]=valueList;
-        return 1;
-    } else {
-        map<string,list<string> >::iterator mapIter;
-        mapIter=db_.find(keyword);      
-        ((*mapIter).second).push_back(value);
-        return (int)((*mapIter).second).size();
+    vector<pair<string,uint64_t> > profile = access_profile();
+    string temp = fileName + ".tmp";
+    {
+        ofstream out(temp.c_str());
+        out << "# kvparse access profile: lookups per keyword, most first\n";
+        for(unsigned int i=0; i<profile.size(); i++) {
+            out << profile[i].second << ' ' << profile[i].first << '\n';
+        }
+        if(!out.flush()) {
+            throw runtime_error("failed to write access profile: " + temp);
+        }
+    }
+    if(rename(temp.c_str(), fileName.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw runtime_error("failed to write access profile: " + fileName);
     }
 }
 
 /*!
- * \brief remove a given keyword/value pair
- * \param keyword
- * \param value
- * \return 0 if the updated database does not contain a value for keyword, 1 if it does
+ * \brief lay out snapshots by a saved access profile
+ * \param fileName a file written by write_access_profile
+ * \return the number of keywords in the profile; 0 if the file does not exist
  *
- * if the keyword does not exist, do nothing. if removing the value
- * from the keyword results in an empty value list, remove the keyword
- * entry from the database
+ * From the next snapshot on, the profiled keywords are stored first,
+ * most looked-up first, so the hot keywords and their values share the
+ * first cache lines of the snapshot's memory and sit in their home slots
+ * of its index. Everything else follows in keyword order. The profile is
+ * kept across clear(), so a reload is laid out the same way, until
+ * another is read; reading a file that does not exist drops it.
  */
-int kvparse::remove_value(const string &keyword,const string &value)
+size_t kvparse::read_access_profile(const string& fileName)
 {
-	if(!keyword_exists(keyword)) {
-		return 0;
-	}
-	
-    map<string,list<string> >::iterator mapIter;
-    mapIter=db_.find(keyword);
+    vector<string> hot;
+    ifstream in(fileName.c_str());
+    string line;
+    int lineno = 0;
+    while(in && getline(in, line)) {
+        lineno++;
+        if(trim(line).empty() || line[0] == '#') {
+            continue;
+        }
+        istringstream fields(line);
+        uint64_t count;
+        string keyword;
+        if(!(fields >> count >> keyword) || !valid_keyword(keyword)) {
+            ostringstream mystr;
+            mystr << "malformed access profile " << fileName << " (" << lineno << "): " << line;
+            throw runtime_error(mystr.str());
+        }
+        hot.push_back(keyword);
+    }
 
-    list<string> &valueList=(*mapIter).second;
-    list<string>::iterator valueIter;
+    lock_guard<mutex> lock(load_mutex);
+    hot_keywords.swap(hot);
+    loaded_version_++;
+    return hot_keywords.size();
+}
 
-    valueIter=find(valueList.begin(),valueList.end(),value);
-    if(valueIter==valueList.end()) {
+/*!
+ * \brief the number of NUMA nodes snapshots are replicated to
+ * \return 0 if replicas are disabled or the node layout is unknown
+ */
+size_t kvparse::numa_replicas()
+{
+    if(!numa_replicas_.load()) {
         return 0;
     }
-    (void)valueList.erase(valueIter);
+    size_t n = 0;
+    for(const vector<int>& cpus : numa_cpus()) {
+        n += cpus.empty() ? 0 : 1;
+    }
+    return n;
+}
 
-    if(valueList.size()==0) {
-        db_.erase(mapIter);
-        return 0;
-    } else {
-        return (int)valueList.size();
+/*!
+ * \brief the frozen copy of the current version, made on first request
+ *
+ * The loaded values are frozen under load_mutex when they have changed
+ * since the published copy was made; runtime changes are kept current
+ * by publish_change.
+ */
+shared_ptr<const kvparse_frozen> kvparse::current_frozen()
+{
+    shared_ptr<const kvparse_frozen> current = published.load();
+    if(!current || current->loaded_version_ != loaded_version_.load()) {
+        lock_guard<mutex> lock(load_mutex);
+        current = published.load();
+        if(!current || current->loaded_version_ != loaded_version_.load()) {
+            shared_ptr<kvparse_frozen> base = freeze(false);
+            if(numa_replicas_.load()) {
+                const vector<vector<int> >& nodes = numa_cpus();
+                base->replicas_.resize(nodes.size());
+                // the jobs own a reference to the copy, and all of them are
+                // done before any failure is rethrown, so none is left
+                // writing into it once this frame unwinds
+                vector<future<void> > copies;
+                for(unsigned int n=0; n<nodes.size(); n++) {
+                    if(!nodes[n].empty()) {
+                        copies.push_back(worker_for(n, nodes[n]).submit([base, n] {
+                            base->replicas_[n] = replicate(*base);
+                        }));
+                    }
+                }
+                for(unsigned int i=0; i<copies.size(); i++) {
+                    copies[i].wait();
+                }
+                for(unsigned int i=0; i<copies.size(); i++) {
+                    copies[i].get();
+                }
+            }
+            current = publish(base);
+        }
     }
+    return current;
 }
 
 /*!
- * \brief check to see if a keyword is in the database
- * \param keyword
- * \return true if the keyword exists in the database, false otherwise
+ * \brief the published version, if it is current, without freezing anything
+ * \return the copy on the caller's NUMA node, or null if the loaded values
+ *         have changed since the last snapshot
  */
-bool kvparse::keyword_exists(const string &keyword)
+shared_ptr<const kvparse_frozen> kvparse::published_frozen()
 {
-    map<string,list<string> >::const_iterator iter;
-    iter=db_.find(keyword);
-    if(iter==db_.end()) {
-        return false;
+    shared_ptr<const kvparse_frozen> current = published.load();
+    if(!current || current->loaded_version_ != loaded_version_.load()) {
+        return shared_ptr<const kvparse_frozen>();
     }
-    return true;
+    return node_local(current);
 }
 
+namespace {
+
+//! serializes publishing new overlays of runtime changes
+mutex overlay_mutex;
+
+}  // namespace
+
 /*!
- * \brief check to see if a keyword is mapped to a single unique value
- * \param keyword
- * \return true if the keyword exists and has a single specified value; false otherwise
+ * \brief publish a new copy of the loaded values with the current runtime changes over it
+ * \param base a copy of the loaded values made by freeze(false)
+ * \return the published version
  */
-bool kvparse::has_unique_value(const string &keyword)
+shared_ptr<const kvparse_frozen> kvparse::publish(const shared_ptr<const kvparse_frozen>& base)
 {
-    if(!keyword_exists(keyword)) {
-		return false;
-	}
-	
-    map<string,list<string> >::const_iterator iter;
-    iter=db_.find(keyword);
+    lock_guard<mutex> lock(overlay_mutex);
+    shared_ptr<kvparse_frozen::overlay_map> changes = make_shared<kvparse_frozen::overlay_map>();
+    if(runtime_count_.load() != 0) {
+        for(size_t i=0; i<runtime_shard_count; i++) {
+            shared_lock<shared_mutex> stripe(runtime_shards[i].lock);
+            for(const pair<const string, shared_ptr<const runtime_values> >& r : runtime_shards[i].entries) {
+                shared_ptr<const kvparse_frozen::overlay_entry> c = kvparse_frozen::changed_entry(r.first, r.second);
+                changes->emplace(c->keyword, c);
+            }
+        }
+    }
+    shared_ptr<const kvparse_frozen> current = kvparse_frozen::layered(base, changes, version_.load());
+    published.store(current);
+    return current;
+}
 
-    const list<string> &valueList=(*iter).second;
-    if(valueList.size()!=1) {
-        return false;
+/*!
+ * \brief publish a runtime change to one keyword over the published copy
+ *
+ * Called by the writer after the change is in place and its stripe is
+ * released. Only the changed keyword's entry is built; the overlay map is
+ * copied, which shares the other keywords' entries, so the cost grows with
+ * the number of keywords changed at run time, never with the database.
+ * Writers publish one at a time, each from the current contents of the
+ * runtime table, so the last to publish leaves the latest values.
+ */
+void kvparse::publish_change(string_view keyword)
+{
+    lock_guard<mutex> lock(overlay_mutex);
+    shared_ptr<const kvparse_frozen> current = published.load();
+    if(!current) {
+        return;
+    }
+    shared_ptr<kvparse_frozen::overlay_map> changes = current->overlay_ ?
+        make_shared<kvparse_frozen::overlay_map>(*current->overlay_) : make_shared<kvparse_frozen::overlay_map>();
+    changes->erase(keyword);
+    shared_ptr<const runtime_values> text = runtime_lookup(keyword);
+    if(text) {
+        shared_ptr<const kvparse_frozen::overlay_entry> c = kvparse_frozen::changed_entry(keyword, text);
+        changes->emplace(c->keyword, c);
     }
+    published.store(kvparse_frozen::layered(current->base_ ? current->base_ : current, changes, version_.load()));
+}
 
-    return true;  
+/*!
+ * \brief lay out the values a keyword was given at run time as an entry
+ * \param text the values, or an empty list if the keyword was removed
+ */
+shared_ptr<const kvparse_frozen::overlay_entry> kvparse_frozen::changed_entry(string_view keyword,
+                                                                              const shared_ptr<const vector<string> >& text)
+{
+    shared_ptr<overlay_entry> c = make_shared<overlay_entry>();
+    c->keyword = string(keyword);
+    c->text = text;
+    c->removed = text->empty();
+    c->values.assign(text->begin(), text->end());
+    for(const string_view& v : c->values) {
+        for(string_view token : kvparse_token_view(v)) {
+            c->tokens.push_back(token);
+        }
+    }
+    c->e.keyword = c->keyword;
+    c->e.first = c->values.data();
+    c->e.count = c->values.size();
+    c->e.first_token = c->tokens.data();
+    c->e.token_count = c->tokens.size();
+    c->e.valid = true;
+    c->e.error = kv_errc::missing_keyword;
+    return c;
 }
 
 /*!
- * \brief return the list of values associated with a keyword
- * \param keyword
- * \return the list of values associated with the keyword
+ * \brief a version made of a copy of the loaded values and runtime changes over it
+ *
+ * The copy's NUMA replicas get layers of their own over the same changes.
+ */
+shared_ptr<const kvparse_frozen> kvparse_frozen::layered(const shared_ptr<const kvparse_frozen>& base,
+                                                         const shared_ptr<const overlay_map>& changes,
+                                                         uint64_t version)
+{
+    if(changes->empty() && version == base->version_) {
+        return base;
+    }
+    size_t size = base->size();
+    for(const pair<const string_view, shared_ptr<const overlay_entry> >& c : *changes) {
+        bool loaded = base->locate(c.first) != 0;
+        if(c.second->removed) {
+            size -= loaded ? 1 : 0;
+        } else {
+            size += loaded ? 0 : 1;
+        }
+    }
+    auto layer = [&](const shared_ptr<const kvparse_frozen>& copy) {
+        shared_ptr<kvparse_frozen> top(new kvparse_frozen());
+        top->version_ = version;
+        top->loaded_version_ = copy->loaded_version_;
+        top->base_ = copy;
+        top->overlay_ = changes;
+        top->size_ = size;
+        return top;
+    };
+    shared_ptr<kvparse_frozen> top = layer(base);
+    top->replicas_.resize(base->replicas_.size());
+    for(unsigned int n=0; n<base->replicas_.size(); n++) {
+        if(base->replicas_[n]) {
+            top->replicas_[n] = layer(base->replicas_[n]);
+        }
+    }
+    return top;
+}
+
+/*!
+ * \brief make an immutable copy of the current database
+ * \param with_runtime apply the values set at run time, or copy only the
+ *        loaded values, for publish to lay the runtime changes over
  *
- * The keyword must exist in the database.
+ * Interpolated values are expanded first, so the copy is self-contained
+ * and the exact amount of memory it needs is known before anything is
+ * copied. The caller must hold load_mutex.
  */
-list<string> kvparse::values(const string &keyword)
+shared_ptr<kvparse_frozen> kvparse::freeze(bool with_runtime)
 {
-    assert(keyword_exists(keyword));
+    struct resolved
+    {
+        string_view keyword;
+        const value_list* values;
+        bool valid;
+        kv_errc error;
+    };
 
-    map<string,list<string> >::const_iterator iter = db_.find(keyword);
-	const list<string>& values = (*iter).second;
+    // the versions are read first, so a change made while copying leaves
+    // this copy looking stale rather than current
+    uint64_t loaded_version = loaded_version_.load();
+    uint64_t version = version_.load();
 
-	list<string> ls;
-	vector<string> tokens;
-	boost::split(tokens, values.front(), boost::is_any_of(" \t"));
-	for(unsigned int i=0; i<tokens.size(); i++) {
-		ls.push_back(tokens[i]);
-	}
-	return ls;
+    // values set at run time replace the database's own, and are taken
+    // literally; loaded values have their references expanded
+    vector<effective_entry> entries;
+    effective_storage storage;
+    if(with_runtime) {
+        effective_values(string_view(), entries, storage);
+    } else {
+        entries.reserve(db_.size());
+        for(database::const_iterator iter=db_.begin(); iter!=db_.end(); ++iter) {
+            effective_entry e = { iter->first, &iter->second, false };
+            entries.push_back(e);
+        }
+    }
+
+    vector<resolved> items;
+    vector<value_hold> holds;
+    items.reserve(entries.size());
+    for(unsigned int i=0; i<entries.size(); i++) {
+        resolved r = { entries[i].keyword, entries[i].values, true, kv_errc::missing_keyword };
+        if(!entries[i].changed) {
+            value_hold hold;
+            r.values = lookup(r.keyword, &r.error, &hold);
+            if(hold) {
+                holds.push_back(hold);
+            }
+            if(r.values == 0) {
+                r.values = entries[i].values;
+                r.valid = false;
+            }
+        }
+        items.push_back(r);
+    }
+
+    // profiled keywords go first, most looked-up first; the rest stay in
+    // keyword order
+    vector<uint32_t> order(items.size());
+    for(unsigned int i=0; i<items.size(); i++) {
+        order[i] = i;
+    }
+    if(!hot_keywords.empty()) {
+        map<string_view, size_t, less<> > rank;
+        for(unsigned int i=0; i<hot_keywords.size(); i++) {
+            rank.emplace(hot_keywords[i], i);
+        }
+        vector<size_t> item_rank(items.size());
+        for(unsigned int i=0; i<items.size(); i++) {
+            map<string_view, size_t, less<> >::const_iterator r = rank.find(items[i].keyword);
+            item_rank[i] = r == rank.end() ? rank.size() : r->second;
+        }
+        stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return item_rank[a] < item_rank[b]; });
+    }
+
+    size_t bytes = 0;
+    size_t nvalues = 0;
+    size_t ntokens = 0;
+    for(unsigned int i=0; i<items.size(); i++) {
+        bytes += items[i].keyword.size();
+        for(value_list::const_iterator v=items[i].values->begin(); v!=items[i].values->end(); ++v) {
+            bytes += v->size();
+            ntokens += std::ranges::distance(kvparse_token_view(*v));
+        }
+        nvalues += items[i].values->size();
+    }
+
+    shared_ptr<kvparse_frozen> frozen(new kvparse_frozen());
+    frozen->version_ = version;
+    frozen->loaded_version_ = loaded_version;
+    frozen->arena_.reset(new char[bytes ? bytes : 1]);
+    frozen->values_.reserve(nvalues);
+    frozen->tokens_.reserve(ntokens);
+    frozen->entries_.reserve(items.size());
+    frozen->sorted_.resize(items.size());
+
+    char* dest = frozen->arena_.get();
+    for(unsigned int n=0; n<items.size(); n++) {
+        unsigned int i = order[n];
+        frozen->sorted_[i] = n;
+        kvparse_frozen::entry e;
+        memcpy(dest, items[i].keyword.data(), items[i].keyword.size());
+        e.keyword = string_view(dest, items[i].keyword.size());
+        dest += items[i].keyword.size();
+
+        e.first = frozen->values_.data()+frozen->values_.size();
+        e.count = items[i].values->size();
+        e.first_token = frozen->tokens_.data()+frozen->tokens_.size();
+        e.valid = items[i].valid;
+        e.error = items[i].error;
+        for(value_list::const_iterator v=items[i].values->begin(); v!=items[i].values->end(); ++v) {
+            memcpy(dest, v->data(), v->size());
+            string_view copy(dest, v->size());
+            frozen->values_.push_back(copy);
+            for(string_view token : kvparse_token_view(copy)) {
+                frozen->tokens_.push_back(token);
+            }
+            dest += v->size();
+        }
+        e.token_count = frozen->tokens_.data()+frozen->tokens_.size()-e.first_token;
+        frozen->entries_.push_back(e);
+    }
+    frozen->arena_size_ = bytes;
+    frozen->build_index();
+    return frozen;
 }
 
 /*!
- * \brief return the first value associated with a keyword
- * \param keyword
- * \return the first value associated with a keyword as a string
+ * \brief build the hash index over the entries
+ */
+void kvparse_frozen::build_index()
+{
+    size_t size = 16;
+    while(size < 2*entries_.size()) {
+        size *= 2;
+    }
+    slots_.assign(size, slot());
+    for(size_t e=0; e<entries_.size(); e++) {
+        size_t h = hash(entries_[e].keyword);
+        size_t i = h & (size-1);
+        while(slots_[i].index != 0) {
+            i = (i+1) & (size-1);
+        }
+        slots_[i].tag = (uint32_t)(h >> 32);
+        slots_[i].index = e+1;
+    }
+}
+
+/*!
+ * \brief copy a frozen database into memory local to the calling thread
  *
- * The keyword must exist in the database.
+ * Run on a node_worker, so the copy's pages are allocated on the
+ * worker's node.
  */
-string kvparse::value(const string &keyword)
+shared_ptr<const kvparse_frozen> kvparse::replicate(const kvparse_frozen& source)
 {
-    assert(keyword_exists(keyword));
+    shared_ptr<kvparse_frozen> copy(new kvparse_frozen());
+    copy->version_ = source.version_;
+    copy->loaded_version_ = source.loaded_version_;
+    copy->arena_size_ = source.arena_size_;
+    copy->arena_.reset(new char[source.arena_size_ ? source.arena_size_ : 1]);
+    memcpy(copy->arena_.get(), source.arena_.get(), source.arena_size_);
 
-    map<string,list<string> >::const_iterator iter;
-    iter=db_.find(keyword);
+    // everything points into the arena or the value and token arrays,
+    // so each pointer moves by the same offset as its container
+    const char* from = source.arena_.get();
+    char* to = copy->arena_.get();
+    auto rebase = [&](string_view v) { return string_view(to+(v.data()-from), v.size()); };
+    copy->values_.reserve(source.values_.size());
+    for(const string_view& v : source.values_) {
+        copy->values_.push_back(rebase(v));
+    }
+    copy->tokens_.reserve(source.tokens_.size());
+    for(const string_view& t : source.tokens_) {
+        copy->tokens_.push_back(rebase(t));
+    }
+    copy->slots_ = source.slots_;
+    copy->sorted_ = source.sorted_;
+    copy->entries_.reserve(source.entries_.size());
+    for(kvparse_frozen::entry e : source.entries_) {
+        e.keyword = rebase(e.keyword);
+        e.first = copy->values_.data()+(e.first-source.values_.data());
+        e.first_token = copy->tokens_.data()+(e.first_token-source.tokens_.data());
+        copy->entries_.push_back(e);
+    }
+    return copy;
+}
 
-    const list<string> &values=(*iter).second;
+namespace {
 
-    if(values.size()!=1) {
-        return string();
+// serializes publishers within this process
+mutex publish_mutex;
+
+//! shm_open names must begin with a single slash
+string shared_name(const string& name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/"+name;
+}
+
+string shared_image_name(const string& name, uint64_t generation)
+{
+    return shared_name(name)+"."+to_string(generation);
+}
+
+//! map a shared memory segment; returns null and leaves errno set on failure
+void* map_shared(const string& name, int flags, size_t* size, size_t create_size)
+{
+    int fd = shm_open(name.c_str(), flags, 0644);
+    if(fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (create_size && st.st_size == 0 && ftruncate(fd, create_size) != 0)) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return 0;
+    }
+    *size = create_size && st.st_size == 0 ? create_size : st.st_size;
+    int prot = (flags & O_RDWR) ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* addr = mmap(0, *size, prot, MAP_SHARED, fd, 0);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return addr == MAP_FAILED ? 0 : addr;
+}
+
+}  // namespace
+
+/*!
+ * \brief publish the current database into POSIX shared memory
+ * \param name the name readers attach to, e.g., "/kvparse-ga"
+ * \return the generation number of the new image
+ *
+ * The database is frozen as for snapshot() and copied into a new segment
+ * in a position-independent layout. Once the image is complete, the
+ * generation counter in the control segment is advanced, and the previous
+ * image is unlinked; readers still attached to it keep their mapping until
+ * they refresh. Only one process should publish under a given name.
+ */
+uint64_t kvparse::publish_shared(const string& name)
+{
+    typedef kvparse_shared::image_header image_header;
+    typedef kvparse_shared::image_entry image_entry;
+    typedef kvparse_shared::image_value image_value;
+
+    shared_ptr<const kvparse_frozen> frozen;
+    {
+        lock_guard<mutex> lock(load_mutex);
+        frozen = freeze(true);
     }
+    lock_guard<mutex> lock(publish_mutex);
 
-    return values.front();
+    size_t control_size;
+    kvparse_shared::control_block* control = static_cast<kvparse_shared::control_block*>(
+        map_shared(shared_name(name), O_RDWR | O_CREAT, &control_size, sizeof(kvparse_shared::control_block)));
+    if(control == 0) {
+        throw runtime_error("failed to create shared configuration: " + shared_name(name));
+    }
+    control->magic = kvparse_shared::control_magic;
+    uint64_t generation = control->generation.load(memory_order_acquire)+1;
+
+    // lay out the image: header, entries, values, then the string bytes
+    size_t nvalues = frozen->values_.size();
+    size_t bytes = 0;
+    for(unsigned int i=0; i<frozen->entries_.size(); i++) {
+        bytes += frozen->entries_[i].keyword.size();
+    }
+    for(unsigned int i=0; i<nvalues; i++) {
+        bytes += frozen->values_[i].size();
+    }
+    size_t entries_at = sizeof(image_header);
+    size_t values_at = entries_at + frozen->entries_.size()*sizeof(image_entry);
+    size_t strings_at = values_at + nvalues*sizeof(image_value);
+    size_t size = strings_at + bytes;
+
+    string image_name = shared_image_name(name, generation);
+    shm_unlink(image_name.c_str());
+    size_t mapped_size;
+    char* image = static_cast<char*>(map_shared(image_name, O_RDWR | O_CREAT | O_EXCL, &mapped_size, size));
+    if(image == 0) {
+        munmap(control, control_size);
+        throw runtime_error("failed to create shared configuration: " + image_name);
+    }
+
+    image_header* header = reinterpret_cast<image_header*>(image);
+    header->magic = kvparse_shared::image_magic;
+    header->version = frozen->version();
+    header->size = size;
+    header->entry_count = frozen->entries_.size();
+    header->entries = entries_at;
+    header->values = values_at;
+
+    image_entry* entries = reinterpret_cast<image_entry*>(image+entries_at);
+    image_value* values = reinterpret_cast<image_value*>(image+values_at);
+    size_t at = strings_at;
+    size_t nvalue = 0;
+    for(unsigned int i=0; i<frozen->entries_.size(); i++) {
+        // the image is searched by bisection, so it stays in keyword order
+        const kvparse_frozen::entry& e = frozen->entries_[frozen->sorted_[i]];
+        entries[i].keyword = at;
+        entries[i].keyword_size = e.keyword.size();
+        entries[i].count = e.count;
+        entries[i].first = nvalue;
+        entries[i].valid = e.valid;
+        entries[i].error = static_cast<uint32_t>(e.error);
+        memcpy(image+at, e.keyword.data(), e.keyword.size());
+        at += e.keyword.size();
+        for(const string_view* v=e.begin(); v!=e.end(); ++v, ++nvalue) {
+            values[nvalue].offset = at;
+            values[nvalue].size = v->size();
+            memcpy(image+at, v->data(), v->size());
+            at += v->size();
+        }
+    }
+    munmap(image, mapped_size);
+
+    // readers pick up the new image from here on
+    control->generation.store(generation, memory_order_release);
+    munmap(control, control_size);
+    if(generation > 1) {
+        shm_unlink(shared_image_name(name, generation-1).c_str());
+    }
+    return generation;
 }
 
 /*!
- * \brief display the contents of the configuration database
+ * \brief remove a published database
+ *
+ * Readers that are attached keep their current image until they go away.
  */
-void kvparse::dump_contents(ostream &ostr)
+void kvparse::unpublish_shared(const string& name)
 {
-    map<string,list<string> >::const_iterator mapIter;  
-    for(mapIter=db_.begin(); mapIter!=db_.end(); mapIter++) {
-        ostr << "Keyword: " << (*mapIter).first << "  |  ";
-        const list<string> &values=(*mapIter).second;
-        list<string>::const_iterator valueIter;
-        ostr << "Values: ";
-        for(valueIter=values.begin(); valueIter!=values.end(); valueIter++) {
-            ostr << *valueIter << " ";
+    lock_guard<mutex> lock(publish_mutex);
+    size_t control_size;
+    kvparse_shared::control_block* control = static_cast<kvparse_shared::control_block*>(
+        map_shared(shared_name(name), O_RDONLY, &control_size, 0));
+    if(control != 0) {
+        shm_unlink(shared_image_name(name, control->generation.load()).c_str());
+        munmap(control, control_size);
+    }
+    shm_unlink(shared_name(name).c_str());
+}
+
+/*!
+ * \brief attach to a database published under the given name
+ *
+ * Throws runtime_error if nothing has been published under the name.
+ */
+kvparse_shared::kvparse_shared(const string& name) :
+    name_(name), control_(0), image_(0), image_size_(0), generation_(0)
+{
+    size_t control_size;
+    control_ = static_cast<const control_block*>(map_shared(shared_name(name), O_RDONLY, &control_size, 0));
+    if(control_ == 0 || control_size < sizeof(control_block) || control_->magic != control_magic) {
+        if(control_ != 0) {
+            munmap(const_cast<control_block*>(control_), control_size);
+        }
+        throw runtime_error("no shared configuration published as: " + shared_name(name));
+    }
+    if(!refresh()) {
+        munmap(const_cast<control_block*>(control_), sizeof(control_block));
+        throw runtime_error("no shared configuration published as: " + shared_name(name));
+    }
+}
+
+kvparse_shared::~kvparse_shared()
+{
+    if(image_ != 0) {
+        munmap(const_cast<char*>(image_), image_size_);
+    }
+    munmap(const_cast<control_block*>(control_), sizeof(control_block));
+}
+
+/*!
+ * \brief switch to the most recently published image, if it is newer
+ * \return true if a different image is now attached
+ *
+ * Views obtained from the previous image become invalid once this
+ * returns true.
+ */
+bool kvparse_shared::refresh()
+{
+    for(;;) {
+        uint64_t generation = control_->generation.load(memory_order_acquire);
+        if(generation == 0 || generation == generation_) {
+            return false;
+        }
+        if(attach(generation)) {
+            return true;
+        }
+        // the image was replaced between reading the counter and opening
+        // it; try again unless the counter has not moved
+        if(errno != ENOENT || control_->generation.load(memory_order_acquire) == generation) {
+            throw runtime_error("failed to attach shared configuration: " + shared_image_name(name_, generation));
         }
-        ostr << endl;
     }
 }
 
+bool kvparse_shared::attach(uint64_t generation)
+{
+    size_t size;
+    const char* image = static_cast<const char*>(map_shared(shared_image_name(name_, generation), O_RDONLY, &size, 0));
+    if(image == 0) {
+        return false;
+    }
+    const image_header* h = reinterpret_cast<const image_header*>(image);
+    if(size < sizeof(image_header) || h->magic != image_magic || h->size != size) {
+        munmap(const_cast<char*>(image), size);
+        errno = EINVAL;
+        return false;
+    }
+    if(image_ != 0) {
+        munmap(const_cast<char*>(image_), image_size_);
+    }
+    image_ = image;
+    image_size_ = size;
+    generation_ = generation;
+    return true;
+}
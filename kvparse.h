@@ -18,20 +18,281 @@
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <memory_resource>
 #include <vector>
 #include <list>
 #include <string>
+#include <string_view>
+#include <future>
+#include <functional>
+#include <coroutine>
+#include <exception>
+#include <expected>
+#include <charconv>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <array>
+#include <bit>
+#include <type_traits>
+#include <utility>
 #include <iostream>
 #include <boost/regex.hpp>
 #include "kvparse_except.h"
 
 using std::string;
+using std::string_view;
 using std::list;
 using std::vector;
 using std::ostream;
+using std::istream;
+using std::future;
 using std::map;
 using std::istringstream;
 
+class kvparse_section;
+class kvparse_incremental_parser;
+class kvparse_frozen;
+class kvparse_snapshot;
+class kvparse_shared;
+class kvparse_value_view;
+template <size_t N> class kvparse_defaults;
+
+/*!
+ * \class kvparse_token_view
+ *
+ * A view of the whitespace-separated tokens in a value, e.g., "1 2 4" as
+ * "1", "2", "4". Runs of blanks and tabs separate tokens; empty tokens are
+ * skipped. Iterating refers into the value and never allocates.
+ */
+class kvparse_token_view : public std::ranges::view_interface<kvparse_token_view>
+{
+public:
+    class iterator
+    {
+    public:
+        typedef string_view value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::forward_iterator_tag iterator_concept;
+
+        iterator() : rest_(), token_() {}
+        explicit iterator(string_view text) : rest_(text), token_() { next(); }
+
+        string_view operator*() const { return token_; }
+        iterator& operator++() { next(); return *this; }
+        iterator operator++(int) { iterator old = *this; next(); return old; }
+
+        bool operator==(const iterator& that) const { return token_.data() == that.token_.data(); }
+        bool operator==(std::default_sentinel_t) const { return token_.data() == 0; }
+
+    private:
+        void next() {
+            string_view::size_type first = rest_.find_first_not_of(" \t");
+            if(first == string_view::npos) {
+                rest_ = token_ = string_view();
+                return;
+            }
+            rest_.remove_prefix(first);
+            token_ = rest_.substr(0, rest_.find_first_of(" \t"));
+            rest_.remove_prefix(token_.size());
+        }
+
+        string_view rest_;
+        string_view token_;
+    };
+
+    kvparse_token_view() : text_() {}
+    explicit kvparse_token_view(string_view text) : text_(text) {}
+
+    iterator begin() const { return iterator(text_); }
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+    string_view text_;
+};
+
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<kvparse_token_view> = true;
+
+/*!
+ * \class kvparse_matrix
+ *
+ * A two-dimensional value, e.g., "[0 1 2; 1 0 3]", held in one contiguous
+ * row-major buffer. Element access follows std::mdspan (extent(r),
+ * operator[](i,j), data_handle()), so code written against it carries
+ * over unchanged once mdspan is available.
+ *
+ * A matrix constructed with a shape only accepts values of that shape;
+ * a default-constructed one takes whatever shape the value has. Reading
+ * into a matrix reuses its buffer, so rereading a value of the same size
+ * does not allocate.
+ */
+template <typename T>
+class kvparse_matrix
+{
+public:
+    typedef T element_type;
+    typedef typename vector<T>::reference reference;
+    typedef typename vector<T>::const_reference const_reference;
+
+    kvparse_matrix() : data_(), rows_(0), cols_(0), fixed_(false) {}
+    kvparse_matrix(size_t rows, size_t cols) : data_(), rows_(rows), cols_(cols), fixed_(true) {}
+
+    static constexpr size_t rank() { return 2; }
+    size_t extent(size_t r) const { return r == 0 ? rows_ : cols_; }
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t size() const { return rows_*cols_; }
+    bool empty() const { return size() == 0; }
+    bool fixed_shape() const { return fixed_; }
+
+    reference operator[](size_t i, size_t j) { return data_[i*cols_+j]; }
+    const_reference operator[](size_t i, size_t j) const { return data_[i*cols_+j]; }
+
+    T* data_handle() { return data_.data(); }
+    const T* data_handle() const { return data_.data(); }
+    std::span<T> row(size_t i) { return std::span<T>(data_.data()+i*cols_, cols_); }
+    std::span<const T> row(size_t i) const { return std::span<const T>(data_.data()+i*cols_, cols_); }
+
+private:
+    vector<T> data_;
+    size_t rows_;
+    size_t cols_;
+    bool fixed_;
+
+    friend class kvparse;
+};
+
+/*!
+ * \brief the names of an enum's values, for reading it with parameter_value
+ *
+ * Specialize for each enum that configuration values name, with a table
+ * of every accepted name and the value it stands for:
+ *
+ *     enum class selection { tournament, roulette };
+ *
+ *     template <>
+ *     struct kvparse_enum_names<selection>
+ *     {
+ *         static constexpr std::array<std::pair<string_view,selection>,2> names = {{
+ *             { "tournament", selection::tournament },
+ *             { "roulette", selection::roulette },
+ *         }};
+ *     };
+ */
+template <typename E>
+struct kvparse_enum_names;
+
+/*!
+ * \brief reached only when an enum's name table cannot be indexed
+ *
+ * Like kvparse_embedded_syntax_error_see_defaults_text, deliberately not
+ * constexpr and never defined, so the build stops with this name in the
+ * diagnostic. The cause is a name listed twice, or, far less likely, a
+ * table so large that no seed tried separates all its names.
+ */
+void kvparse_enum_names_must_be_distinct();
+
+//! seeded FNV-1a, for the perfect hash over an enum's names
+constexpr uint32_t kvparse_enum_hash(uint32_t seed, string_view name)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for(char c : name) {
+        h = (h ^ (unsigned char)c) * 16777619u;
+    }
+    return h;
+}
+
+//! slots for n names: enough that a collision-free seed is quickly found
+constexpr size_t kvparse_enum_slots(size_t n)
+{
+    return std::bit_ceil(std::max<size_t>(n*n, 4));
+}
+
+//! a seed under which no two names hash to the same slot, and the slots
+template <size_t Slots>
+struct kvparse_enum_layout
+{
+    uint32_t seed;
+    std::array<uint16_t,Slots> index;  //!< one more than the name's position; 0 if empty
+};
+
+template <typename E>
+consteval auto kvparse_build_enum_layout()
+{
+    constexpr const auto& names = kvparse_enum_names<E>::names;
+    constexpr size_t slots = kvparse_enum_slots(std::size(names));
+    static_assert(std::size(names) < 65535, "too many names for one enum");
+
+    for(size_t i=0; i<std::size(names); i++) {
+        for(size_t j=0; j<i; j++) {
+            if(names[i].first == names[j].first) {
+                kvparse_enum_names_must_be_distinct();
+            }
+        }
+    }
+
+    kvparse_enum_layout<slots> layout = { 0, {} };
+    for(uint32_t seed=0; seed<4096; seed++) {
+        layout.seed = seed;
+        layout.index.fill(0);
+        bool collided = false;
+        for(size_t i=0; i<std::size(names) && !collided; i++) {
+            uint16_t& slot = layout.index[kvparse_enum_hash(seed, names[i].first) & (slots-1)];
+            collided = (slot != 0);
+            slot = i+1;
+        }
+        if(!collided) {
+            return layout;
+        }
+    }
+    kvparse_enum_names_must_be_distinct();
+    return layout;
+}
+
+/*!
+ * \class kvparse_enum_table
+ *
+ * A perfect hash from the names in kvparse_enum_names<E> to their values,
+ * built while the program is compiled. A lookup hashes the name once and
+ * compares it with the single candidate in its slot.
+ */
+template <typename E>
+class kvparse_enum_table
+{
+public:
+    static constexpr const auto& names = kvparse_enum_names<E>::names;
+
+    //! the value a name stands for, or null if it is not one of the names
+    static constexpr const E* find(string_view name) {
+        uint16_t i = layout_.index[kvparse_enum_hash(layout_.seed, name) & (layout_.index.size()-1)];
+        if(i == 0 || names[i-1].first != name) {
+            return 0;
+        }
+        return &names[i-1].second;
+    }
+
+    //! every name, quoted and separated by commas
+    static string valid_names() {
+        string list;
+        for(const auto& n : names) {
+            list += (list.empty() ? "'" : ",'") + string(n.first) + "'";
+        }
+        return list;
+    }
+
+private:
+    static constexpr auto layout_ = kvparse_build_enum_layout<E>();
+};
+
+//! an enum whose names have been given with kvparse_enum_names
+template <typename E>
+concept kvparse_named_enum = std::is_enum_v<E> && requires { kvparse_enum_names<E>::names; };
+
 /*!
  * \class kvparse
  *
@@ -42,10 +303,64 @@ using std::istringstream;
  */
 class kvparse
 {
+public:
+    // keywords and values are interned, so the database holds views of
+    // the single shared copy of each distinct string
+    typedef std::pmr::list<string_view> value_list;
+    typedef std::pmr::map<string_view,value_list,std::less<> > database;
+
+    /*!
+     * \brief counters describing the effect of interning
+     *
+     * Every keyword and value passed through add_value is a reference;
+     * only the first occurrence of each distinct string is stored.
+     */
+    struct intern_stats
+    {
+        size_t references;       //!< strings passed in for interning
+        size_t unique;           //!< distinct strings actually stored
+        size_t bytes_referenced; //!< total length of all references
+        size_t bytes_stored;     //!< total length of the stored copies
+
+        double dedup_ratio() const {
+            return unique ? (double)references/unique : 0.0;
+        }
+        size_t bytes_saved() const {
+            return bytes_referenced-bytes_stored;
+        }
+    };
+
+    //! whether read_configuration_buffer copies its input or refers to it
+    enum buffer_ownership { copy_buffer, borrow_buffer };
+
+    /*!
+     * \brief where the time and memory of one read_configuration_file went
+     *
+     * Filled in when a load_stats is passed to read_configuration_file.
+     * Building with KVPARSE_NO_LOAD_STATS defined removes the collection
+     * entirely, and the counters are then left at zero.
+     */
+    struct load_stats
+    {
+        double io_seconds;          //!< reading the file
+        double decompress_seconds;  //!< inflating compressed input
+        double comment_seconds;     //!< stripping comments
+        double validate_seconds;    //!< blank-line and delimiter checks, keyword validation
+        double trim_seconds;        //!< trimming keywords and values
+        double insert_seconds;      //!< interning and adding entries to the database
+        double total_seconds;       //!< the whole call, including locking and anything not above
+
+        size_t bytes;               //!< bytes read from the file
+        size_t lines;               //!< lines parsed, including blank and comment lines
+        size_t entries;             //!< keyword/value pairs inserted
+        size_t allocations;         //!< heap allocations for read buffers, interned strings and entries
+        size_t longest_line;        //!< length in bytes of the longest line
+    };
+
 private:
     // my current collection of configuration parameters,
     // represented as keyword,value pairs.
-    static map<string,list<string> > db_;
+    static database db_;
 
     // disable construction/copying
     kvparse();
@@ -56,239 +371,1703 @@ private:
     template <typename T>
     static T from_string(const string& val);
 
-    static int add_value(const string &keyword,const string &value);
-    static int remove_value(const string &keyword,const string &value);
-    static list<string> values(const string &keyword);
-    static string value(const string &keyword);
+    static bool load_direct(const std::function<bool(database&)>& parse);
+    static bool load_layer(const string& layer, const std::function<bool(database&)>& parse);
+    static void merge_layers();
+    static bool parse_stream(database& db, istream& in, const string& filename);
+    static bool parse_buffer(database& db, string_view buffer, const string& filename, bool borrowed);
+    static bool parse_gzip(database& db, string_view head, int fd, const string& filename);
+
+    //! a bracketed value whose closing ']' has not been read yet
+    struct open_bracket
+    {
+        string keyword;
+        string text;
+        int lineno;
+
+        open_bracket() : keyword(), text(), lineno(0) {}
+    };
+
+    static void parse_line(database& db, string_view line, const string& filename, int lineno,
+                           open_bracket& open, bool borrowed=false);
+    static void check_closed(const open_bracket& open, const string& filename);
+    static void add_assignment(database& db, string_view keyword, string_view value, const string& source);
+    static int add_value(database& db, string_view keyword, string_view value, bool borrowed=false);
+
+    //! keeps values returned by lookup alive while they are read; stored
+    //! values need nothing, but an expansion can be discarded at any time
+    typedef std::shared_ptr<const void> value_hold;
+
+    static inline const value_list* lookup(string_view keyword, kv_errc* err, value_hold* hold);
+    static const value_list* interpolate(database::const_iterator iter, kv_errc* err, value_hold* hold);
+    static const value_list* expand(database::const_iterator iter, vector<string_view>& in_progress,
+                                           kv_errc* err);
+
+    //! convert a single stored value to a T; returns false if it is malformed
+    template <typename T>
+    static bool parse_value(string_view text, T& res);
+
+    template <typename T>
+    static string value_hint();
+
+    template <typename T>
+    [[noreturn]] static void raise(const kv_error& err);
+
+    template <typename T, typename Values>
+    static std::expected<T,kv_error> convert(string_view keyword, const Values* values, kv_errc err);
+
+    template <typename T>
+    static bool read_scalar(const std::expected<T,kv_error>& val, T& res, bool required);
+
+    template <typename T, typename Values>
+    static bool read_list(string_view keyword, const Values* values, kv_errc err, list<T>& res, bool required);
+
+    template <typename T, typename Values>
+    static bool read_vector(string_view keyword, const Values* values, kv_errc err, vector<T>& res, bool required);
+
+    template <typename T, typename Values>
+    static bool read_matrix(string_view keyword, const Values* values, kv_errc err, kvparse_matrix<T>& res, bool required);
+
+    // bumped on every change to the database
+    static std::atomic<uint64_t> version_;
+
+    // bumped on every change that a copy of the loaded values would miss:
+    // loads, layer changes, clear(), and runtime changes to keywords that
+    // loaded values refer to with ${...}
+    static std::atomic<uint64_t> loaded_version_;
+
+    // whether try_get consults the per-thread cache of converted values
+    static std::atomic<bool> thread_cache_;
+
+    // whether snapshots are served from a copy on the caller's NUMA node
+    static std::atomic<bool> numa_replicas_;
+
+    // whether lookups are counted per keyword for an access profile
+    static std::atomic<bool> access_profiling_;
+
+    static void record_access(string_view keyword);
+
+    //! count a lookup of keyword if access profiling is on
+    static void note_access(string_view keyword) {
+        if(access_profiling_.load(std::memory_order_relaxed)) {
+            record_access(keyword);
+        }
+    }
+
+    //! values set at run time; an empty list marks a removed keyword
+    typedef vector<string> runtime_values;
+
+    // keywords with values set at run time, so reads can skip that table
+    // entirely while there are none
+    static std::atomic<size_t> runtime_count_;
+
+    static std::shared_ptr<const runtime_values> runtime_lookup(string_view keyword);
+    static std::shared_ptr<const runtime_values> loaded_values(string_view keyword);
+    static std::shared_ptr<const runtime_values> current_values(string_view keyword,
+                                                                const std::shared_ptr<const runtime_values>& loaded);
+
+    //! one keyword as readers see it, with values set at run time applied
+    struct effective_entry
+    {
+        string_view keyword;
+        const value_list* values;
+        bool changed;   // the values were set at run time
+    };
+
+    //! keeps the values of keywords changed at run time alive for a list
+    //! of effective_entry
+    struct effective_storage
+    {
+        vector<std::shared_ptr<const runtime_values> > held;
+        list<value_list> lists;
+    };
+
+    static void effective_values(string_view prefix, vector<effective_entry>& entries, effective_storage& storage);
+    static bool runtime_list(string_view keyword, const value_list** values, value_hold* hold);
+
+    template <typename T>
+    static std::expected<T,kv_error> get_value(string_view keyword);
+
+    //! one slot of the per-thread cache of converted values
+    template <typename T>
+    struct cache_slot
+    {
+        size_t hash;
+        uint64_t version;
+        string keyword;
+        T value;
+
+        cache_slot() : hash(0), version(~(uint64_t)0), keyword(), value() {}
+    };
+
+    static constexpr size_t cache_slots = 128;
+
+    template <typename T>
+    static std::expected<T,kv_error> cached_get(string_view keyword);
+
+    static std::shared_ptr<kvparse_frozen> freeze(bool with_runtime);
+    static std::shared_ptr<const kvparse_frozen> current_frozen();
+    static std::shared_ptr<const kvparse_frozen> published_frozen();
+    static std::shared_ptr<const kvparse_frozen> node_local(const std::shared_ptr<const kvparse_frozen>& frozen);
+    static std::shared_ptr<const kvparse_frozen> publish(const std::shared_ptr<const kvparse_frozen>& base);
+    static void publish_change(string_view keyword);
+    static std::shared_ptr<const kvparse_frozen> replicate(const kvparse_frozen& source);
+
+    static inline bool all_digits(string_view text);
+
+public:
+    static void clear();
+    static bool read_configuration_file(const string &fileName, load_stats* stats=0);
+    static future<bool> read_configuration_file_async(const string &fileName);
+    static future<bool> read_configuration_files_async(const vector<string> &fileNames);
+    static bool read_configuration_buffer(string_view buffer, const string &sourceName="<buffer>",
+                                          buffer_ownership ownership=copy_buffer);
+    static bool read_configuration_stream(istream &in, const string &sourceName="<stream>");
+    template <size_t N>
+    static bool read_defaults(const kvparse_defaults<N>& defaults);
+    static bool keyword_exists(const string &keyword);
+    static bool has_unique_value(const string &keyword);
+    static void set_value(const string& keyword, const string& value);
+    static int append_value(const string& keyword, const string& value);
+    static int remove_value(const string& keyword, const string& value);
+    static size_t open_override_log(const string& fileName, size_t compactBytes=1<<20);
+    static void sync_override_log();
+    static void close_override_log();
+    static void dump_contents(ostream &ostr);
+    static string format_configuration(string_view layout=string_view());
+    static bool write_configuration_file(const string &fileName, bool preserveLayout=true);
+    static intern_stats interning_stats();
+    static void set_memory_resource(std::pmr::memory_resource* resource);
+    static std::pmr::memory_resource* get_memory_resource();
+
+    static void define_layer(const string& name, int precedence);
+    static bool read_layer_file(const string& layer, const string& fileName);
+    static bool read_layer_buffer(const string& layer, string_view buffer, const string& sourceName="<buffer>");
+    template <size_t N>
+    static bool read_layer_defaults(const string& layer, const kvparse_defaults<N>& defaults);
+    static int read_layer_environment(const string& layer, const string& prefix="KV_");
+    static int read_layer_arguments(const string& layer, int argc, const char* const* argv);
+    static void clear_layer(const string& layer);
+    static string source_layer(const string& keyword);
+
+    static uint64_t version();
+    static void set_thread_cache(bool enabled);
+    static kvparse_snapshot snapshot();
+
+    template <typename T>
+    static void get_many(std::span<const string_view> keywords, std::span<std::expected<T,kv_error> > values);
+    static void set_numa_replicas(bool enabled);
+    static size_t numa_replicas();
+    static void set_access_profiling(bool enabled);
+    static vector<std::pair<string,uint64_t> > access_profile();
+    static void write_access_profile(const string& fileName);
+    static size_t read_access_profile(const string& fileName);
+    static uint64_t publish_shared(const string& name);
+    static void unpublish_shared(const string& name);
+
+    friend class kvparse_incremental_parser;
+    friend class kvparse_frozen;
+    friend class kvparse_snapshot;
+    friend class kvparse_shared;
+
+    template <typename F>
+    static void for_each_with_prefix(const string& prefix, F visit);
+
+    static kvparse_section subconfig(const string& prefix);
+
+    static inline kvparse_value_view values(string_view keyword);
+    static inline auto tokens(string_view keyword);
+
+    template <typename T>
+    static inline std::expected<T,kv_error> try_get(string_view keyword);
+
+    template <typename T>
+    static inline bool parameter_value(const string& keyword, T& value, bool required=false);
+
+    template <typename T>
+    static inline bool parameter_value(const string& keyword, vector<T>& value, bool required=false);
+
+    template <typename T>
+    static inline bool parameter_value(const string& keyword, list<T>& value, bool required=false);
+
+    template <typename T>
+    static inline bool parameter_value(const string& keyword, kvparse_matrix<T>& value, bool required=false);
+};
+
+/*!
+ * \class kvparse_value_view
+ *
+ * A view of every value of one keyword, as returned by kvparse::values.
+ * Stored values are referred to in place; values that had to be computed,
+ * such as expanded ${...} references, are kept alive by the view itself.
+ */
+class kvparse_value_view : public std::ranges::view_interface<kvparse_value_view>
+{
+public:
+    kvparse_value_view() : values_(&none()), hold_() {}
+    kvparse_value_view(const kvparse::value_list* values, std::shared_ptr<const void> hold) :
+        values_(values ? values : &none()), hold_(std::move(hold)) {}
+
+    kvparse::value_list::const_iterator begin() const { return values_->begin(); }
+    kvparse::value_list::const_iterator end() const { return values_->end(); }
+    size_t size() const { return values_->size(); }
+
+private:
+    static const kvparse::value_list& none() {
+        static const kvparse::value_list empty;
+        return empty;
+    }
+
+    const kvparse::value_list* values_;
+    std::shared_ptr<const void> hold_;
+};
+
+/*!
+ * \class kvparse_section
+ *
+ * A lightweight view of the keywords sharing a common dotted prefix, e.g.,
+ * "mutation." for "mutation.rate" and "mutation.operator". Keywords passed
+ * to the view are relative to the prefix. The view holds no copy of the
+ * data, so it always reflects the current contents of the database.
+ */
+class kvparse_section
+{
+private:
+    string prefix_;
+
+public:
+    explicit kvparse_section(const string& prefix) : prefix_(prefix) {}
+
+    const string& prefix() const { return prefix_; }
+
+    bool keyword_exists(const string& keyword) const {
+        return kvparse::keyword_exists(prefix_+keyword);
+    }
+
+    bool has_unique_value(const string& keyword) const {
+        return kvparse::has_unique_value(prefix_+keyword);
+    }
+
+    kvparse_section subconfig(const string& prefix) const {
+        return kvparse_section(prefix_+prefix);
+    }
+
+    //! visit each entry in the section; keywords are given relative to the prefix
+    template <typename F>
+    void for_each(F visit) const {
+        const string::size_type n = prefix_.size();
+        kvparse::for_each_with_prefix(prefix_, [&](string_view keyword, const kvparse::value_list& values) {
+            visit(keyword.substr(n), values);
+        });
+    }
+
+    template <typename T>
+    bool parameter_value(const string& keyword, T& value, bool required=false) const {
+        return kvparse::parameter_value(prefix_+keyword, value, required);
+    }
+};
+
+/*!
+ * \class kvparse_frozen
+ *
+ * An immutable copy of the database taken at one version. Keywords and
+ * values are packed into a single block of memory, interpolated values are
+ * expanded once when the copy is made, and entries are found through a
+ * hash index. Entries are stored in keyword order unless an access profile
+ * has been read, in which case the profiled keywords come first, hottest
+ * first; a separate keyword-order index serves prefix scans either way.
+ *
+ * Once values have been set at run time, a version is a copy of the loaded
+ * values with a small overlay of the changed keywords on top, which is
+ * consulted first. A runtime change publishes a new overlay over the same
+ * copy, so it never copies the whole database.
+ */
+class kvparse_frozen
+{
+public:
+    //! a keyword and its values, which are stored contiguously
+    struct entry
+    {
+        string_view keyword;
+        const string_view* first;
+        size_t count;
+        const string_view* first_token;  //!< the tokens of all the values, in order
+        size_t token_count;
+        bool valid;     //!< false if the values' ${...} references could not be expanded
+        kv_errc error;  //!< why the references could not be expanded
+
+        size_t size() const { return count; }
+        const string_view& front() const { return *first; }
+        const string_view* begin() const { return first; }
+        const string_view* end() const { return first+count; }
+    };
+
+    uint64_t version() const { return version_; }
+    size_t size() const { return base_ ? size_ : entries_.size(); }
+
+    inline const entry* find(string_view keyword) const;
+    inline const entry* lookup(string_view keyword, kv_errc* err) const;
+    inline void find_many(const string_view* keywords, const entry** found, size_t n) const;
+
+    //! keywords find_many works on at once; enough to keep many misses in flight
+    static constexpr size_t batch = 16;
+
+    template <typename F>
+    void for_each_with_prefix(string_view prefix, F visit) const;
+
+private:
+    friend class kvparse;
+
+    //! one slot of the open-addressing index from keyword hash to entry
+    struct slot
+    {
+        uint32_t tag;    //!< the high half of the keyword's hash
+        uint32_t index;  //!< one more than the entry's position; 0 if the slot is empty
+    };
+
+    //! a keyword changed at run time, with its values laid out as an entry
+    struct overlay_entry
+    {
+        string keyword;
+        std::shared_ptr<const vector<string> > text;
+        vector<string_view> values;
+        vector<string_view> tokens;
+        entry e;
+        bool removed;   //!< the keyword was removed at run time
+    };
+
+    typedef std::map<string_view, std::shared_ptr<const overlay_entry>, std::less<> > overlay_map;
+
+    static std::shared_ptr<const overlay_entry> changed_entry(string_view keyword,
+                                                              const std::shared_ptr<const vector<string> >& text);
+    static std::shared_ptr<const kvparse_frozen> layered(const std::shared_ptr<const kvparse_frozen>& base,
+                                                         const std::shared_ptr<const overlay_map>& changes,
+                                                         uint64_t version);
+
+    static size_t hash(string_view keyword) { return std::hash<string_view>()(keyword); }
+    inline const entry* locate(string_view keyword) const;
+    inline const entry* probe(string_view keyword, size_t h) const;
+    void build_index();
+
+    uint64_t version_;
+    uint64_t loaded_version_;  //!< the version of the loaded values that were copied
+    std::unique_ptr<char[]> arena_;
+    size_t arena_size_;
+    vector<string_view> values_;
+    vector<string_view> tokens_;
+    vector<entry> entries_;
+    vector<slot> slots_;  //!< a power of two in size, and at most half full
+    vector<uint32_t> sorted_;  //!< entry positions in keyword order
+
+    //! copies of this version placed on each NUMA node, indexed by node
+    vector<std::shared_ptr<const kvparse_frozen> > replicas_;
+
+    //! with runtime changes: the copy of the loaded values, the changes
+    //! over it, and the number of keywords the two make together
+    std::shared_ptr<const kvparse_frozen> base_;
+    std::shared_ptr<const overlay_map> overlay_;
+    size_t size_;
+};
+
+/*!
+ * \class kvparse_snapshot
+ *
+ * A handle pinning one version of the database, obtained from
+ * kvparse::snapshot(). Reads through the handle see that version no matter
+ * what is loaded or changed afterwards, so several related keywords can be
+ * read consistently. The version is released when the last handle to it
+ * goes away.
+ */
+class kvparse_snapshot
+{
+private:
+    std::shared_ptr<const kvparse_frozen> db_;
+
+public:
+    explicit kvparse_snapshot(const std::shared_ptr<const kvparse_frozen>& db) : db_(db) {}
+
+    uint64_t version() const { return db_->version(); }
+    size_t size() const { return db_->size(); }
+
+    inline bool keyword_exists(const string& keyword) const;
+    inline bool has_unique_value(const string& keyword) const;
+
+    inline std::span<const string_view> values(string_view keyword) const;
+    inline std::span<const string_view> tokens(string_view keyword) const;
+
+    //! the keyword's values as stored in the snapshot, or null with err set
+    const kvparse_frozen::entry* lookup(string_view keyword, kv_errc* err) const {
+        return db_->lookup(keyword, err);
+    }
+
+    template <typename F>
+    void for_each_with_prefix(const string& prefix, F visit) const {
+        db_->for_each_with_prefix(prefix, visit);
+    }
+
+    template <typename T>
+    std::expected<T,kv_error> try_get(string_view keyword) const;
+
+    inline void lookup_many(std::span<const string_view> keywords, std::span<const kvparse_frozen::entry*> found) const;
+
+    template <typename T>
+    void get_many(std::span<const string_view> keywords, std::span<std::expected<T,kv_error> > values) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, T& value, bool required=false) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, vector<T>& value, bool required=false) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, list<T>& value, bool required=false) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, kvparse_matrix<T>& value, bool required=false) const;
+};
+
+/*!
+ * \class kvparse_shared
+ *
+ * Read-only access to a database published into POSIX shared memory with
+ * kvparse::publish_shared(). The published image uses offsets rather than
+ * pointers, so every process maps the same pages and serves lookups from
+ * them directly, with no parsing and no private copy.
+ *
+ * A publish writes a complete new image into a fresh segment and then
+ * advances a generation counter in a small control segment, so a reader
+ * only ever sees whole versions and never takes a lock. The attached
+ * version stays in place until refresh() is called; refresh() must not
+ * race with lookups on the same object, so each thread that wants to pick
+ * up changes independently should attach its own reader.
+ */
+class kvparse_shared
+{
+public:
+    //! the control segment, named by the caller
+    struct control_block
+    {
+        uint64_t magic;
+        std::atomic<uint64_t> generation;   //!< 0 until the first publish
+    };
+
+    //! the header at the start of each published image
+    struct image_header
+    {
+        uint64_t magic;
+        uint64_t version;       //!< kvparse::version() at the time of publishing
+        uint64_t size;          //!< bytes in the whole image
+        uint64_t entry_count;
+        uint64_t entries;       //!< offset of the image_entry table
+        uint64_t values;        //!< offset of the image_value table
+    };
+
+    //! one keyword, kept in keyword order; all offsets are from the image start
+    struct image_entry
+    {
+        uint64_t keyword;
+        uint32_t keyword_size;
+        uint32_t count;
+        uint64_t first;         //!< index of the first image_value
+        uint32_t valid;
+        uint32_t error;
+    };
+
+    struct image_value
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static const uint64_t control_magic = 0x6b76706172736543ULL;
+    static const uint64_t image_magic = 0x6b76706172736549ULL;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "the generation counter must be lock-free to live in shared memory");
+
+    //! the values of one keyword, viewed in place
+    class values
+    {
+    public:
+        values(const char* base, const image_entry* e) :
+            base_(base),
+            first_(reinterpret_cast<const image_value*>(base+reinterpret_cast<const image_header*>(base)->values)+e->first),
+            count_(e->count) {}
+
+        size_t size() const { return count_; }
+        string_view operator[](size_t i) const { return string_view(base_+first_[i].offset, first_[i].size); }
+        string_view front() const { return (*this)[0]; }
+
+    private:
+        const char* base_;
+        const image_value* first_;
+        size_t count_;
+    };
+
+    explicit kvparse_shared(const string& name);
+    ~kvparse_shared();
+
+    bool refresh();
+    uint64_t generation() const { return generation_; }
+    uint64_t version() const { return header()->version; }
+    size_t size() const { return header()->entry_count; }
+
+    inline bool keyword_exists(const string& keyword) const;
+    inline bool has_unique_value(const string& keyword) const;
+
+    template <typename F>
+    void for_each_with_prefix(const string& prefix, F visit) const;
+
+    template <typename T>
+    std::expected<T,kv_error> try_get(string_view keyword) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, T& value, bool required=false) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, vector<T>& value, bool required=false) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, list<T>& value, bool required=false) const;
+
+    template <typename T>
+    bool parameter_value(const string& keyword, kvparse_matrix<T>& value, bool required=false) const;
+
+private:
+    kvparse_shared(const kvparse_shared&);
+    kvparse_shared &operator=(const kvparse_shared&);
+
+    const image_header* header() const { return reinterpret_cast<const image_header*>(image_); }
+    const image_entry* entries() const { return reinterpret_cast<const image_entry*>(image_+header()->entries); }
+    string_view keyword_of(const image_entry* e) const { return string_view(image_+e->keyword, e->keyword_size); }
+    const image_entry* find(string_view keyword) const;
+    bool attach(uint64_t generation);
+
+    string name_;
+    const control_block* control_;
+    const char* image_;
+    size_t image_size_;
+    uint64_t generation_;
+};
+
+/*!
+ * \class kvparse_feed_task
+ *
+ * The coroutine type returned by kvparse_incremental_parser::feed_from.
+ * The coroutine starts running immediately and runs until its source
+ * suspends. The task can itself be co_awaited, or polled with done() and
+ * then checked with get(), which rethrows any parse error.
+ */
+class kvparse_feed_task
+{
+public:
+    struct promise_type
+    {
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        kvparse_feed_task get_return_object() {
+            return kvparse_feed_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+
+        struct final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        final_awaiter final_suspend() noexcept { return final_awaiter(); }
+
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    kvparse_feed_task(kvparse_feed_task&& that) : handle_(that.handle_) { that.handle_ = nullptr; }
+    ~kvparse_feed_task() { if(handle_) handle_.destroy(); }
+
+    bool done() const { return handle_.done(); }
+
+    //! rethrow any exception raised while parsing; only valid once done()
+    void get() const {
+        if(handle_.promise().error) {
+            std::rethrow_exception(handle_.promise().error);
+        }
+    }
+
+    bool await_ready() const { return handle_.done(); }
+    void await_suspend(std::coroutine_handle<> waiter) { handle_.promise().continuation = waiter; }
+    void await_resume() const { get(); }
+
+private:
+    explicit kvparse_feed_task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+    kvparse_feed_task(const kvparse_feed_task&);
+    kvparse_feed_task &operator=(const kvparse_feed_task&);
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/*!
+ * \class kvparse_incremental_parser
+ *
+ * Push-style parser for configuration data that arrives in pieces, e.g.,
+ * over a pipe or socket. Data is handed over with feed() in chunks of any
+ * size, and finish() parses whatever is left once the stream ends. Entries
+ * are added to the database as soon as their line is complete.
+ */
+class kvparse_incremental_parser
+{
+private:
+    string source_;
+    string partial_;
+    kvparse::open_bracket open_;
+    int lineno_;
+
+public:
+    explicit kvparse_incremental_parser(const string& source_name="<stream>");
+
+    void feed(const char* data, size_t size);
+    bool finish();
+
+    template <typename Source>
+    kvparse_feed_task feed_from(Source& source);
+};
+
+/*!
+ * \brief coroutine adapter that drains an asynchronous byte source
+ * \param source an object whose read_some() returns an awaitable yielding
+ *        a chunk convertible to string_view; an empty chunk marks the end
+ *
+ * Each chunk is fed to the parser as it arrives, and finish() is called
+ * at the end of the stream. Errors surface through the returned task.
+ */
+template <typename Source>
+kvparse_feed_task kvparse_incremental_parser::feed_from(Source& source)
+{
+    for(;;) {
+        string_view chunk = co_await source.read_some();
+        if(chunk.empty()) {
+            break;
+        }
+        feed(chunk.data(), chunk.size());
+    }
+    finish();
+}
+
+/*!
+ * \brief visit every entry whose keyword begins with the given prefix
+ * \param prefix the keyword prefix, e.g., "mutation."
+ * \param visit callable invoked as visit(string_view keyword, const kvparse::value_list& values)
+ *
+ * The database is kept in keyword order, so the matching entries form a
+ * single contiguous range that is found with one search and then walked in
+ * place. Nothing is copied; the views passed to visit remain valid until
+ * the next call to clear(). Once values have been set at run time, the
+ * matching ones are merged in, as copies that live until visit returns.
+ */
+template <typename F>
+inline void kvparse::for_each_with_prefix(const string& prefix, F visit)
+{
+    if(runtime_count_.load(std::memory_order_acquire) != 0) {
+        vector<effective_entry> entries;
+        effective_storage storage;
+        effective_values(prefix, entries, storage);
+        for(unsigned int i=0; i<entries.size(); i++) {
+            visit(entries[i].keyword, *entries[i].values);
+        }
+        return;
+    }
+    database::const_iterator iter = db_.lower_bound(prefix);
+    for(; iter!=db_.end(); ++iter) {
+        if(iter->first.compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        visit(iter->first, iter->second);
+    }
+}
+
+/*!
+ * \brief return a view of the entries sharing a common keyword prefix
+ */
+inline kvparse_section kvparse::subconfig(const string& prefix)
+{
+    return kvparse_section(prefix);
+}
+
+/*!
+ * \brief view every value of a keyword, including repeated ones
+ * \return the values in the order they were read, with ${...} references
+ *         expanded, or those set at run time; empty if the keyword is
+ *         missing or its references cannot be expanded
+ *
+ * Stored values are referred to in place and are valid until the database
+ * next changes; expanded ones and runtime ones are kept alive by the view.
+ * A keyword changed at run time gets a fresh copy on every call, so do not
+ * mix iterators from different calls.
+ */
+inline kvparse_value_view kvparse::values(string_view keyword)
+{
+    note_access(keyword);
+    kv_errc err;
+    value_hold hold;
+    const value_list* values;
+    if(runtime_count_.load(std::memory_order_acquire) != 0 && runtime_list(keyword, &values, &hold)) {
+        return kvparse_value_view(values, std::move(hold));
+    }
+    values = lookup(keyword, &err, &hold);
+    return kvparse_value_view(values, std::move(hold));
+}
+
+/*!
+ * \brief view the whitespace-separated tokens of every value of a keyword
+ *
+ * "islands: 1 2" followed by "islands: 4" gives "1", "2", "4". Nothing is
+ * allocated; the view is valid until the database next changes.
+ */
+inline auto kvparse::tokens(string_view keyword)
+{
+    return values(keyword)
+        | std::views::transform([](string_view v) { return kvparse_token_view(v); })
+        | std::views::join;
+}
+
+/*!
+ * \brief look up the values stored for a keyword
+ * \param keyword
+ * \param err set to the reason if there are no values to return
+ * \param hold set to keep an expansion alive while the values are read
+ * \return the keyword's values with any ${...} references expanded, or
+ *         null if the keyword does not exist or its references are bad
+ *
+ * Values without references are returned as stored; only keywords that
+ * use interpolation pay for expanding it, and then only once.
+ */
+inline const kvparse::value_list* kvparse::lookup(string_view keyword, kv_errc* err, value_hold* hold)
+{
+    database::const_iterator iter = db_.find(keyword);
+    if(iter == db_.end()) {
+        *err = kv_errc::missing_keyword;
+        return 0;
+    }
+    for(value_list::const_iterator v=iter->second.begin(); v!=iter->second.end(); ++v) {
+        if(v->find("${") != string_view::npos) {
+            return interpolate(iter, err, hold);
+        }
+    }
+    return &iter->second;
+}
+
+/*!
+ * \brief check that a string is a non-empty run of decimal digits
+ */
+inline bool kvparse::all_digits(string_view text)
+{
+    if(text.empty()) {
+        return false;
+    }
+    for(string_view::size_type i=0; i<text.size(); i++) {
+        if(text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * \brief convert a value naming an enum's value, as listed in its
+ *        kvparse_enum_names, and optionally quoted
+ *
+ * This is the only conversion the general template provides; every other
+ * type has its own specialization below.
+ */
+template <typename T>
+inline bool kvparse::parse_value(string_view text, T& res)
+{
+    static_assert(kvparse_named_enum<T>, "no conversion to this type; an enum needs a kvparse_enum_names specialization");
+    if(text.size() >= 2 && text[0] == '"' && text[text.size()-1] == '"') {
+        text = text.substr(1, text.size()-2);
+    }
+    const T* value = kvparse_enum_table<T>::find(text);
+    if(value == 0) {
+        return false;
+    }
+    res = *value;
+    return true;
+}
+
+/*!
+ * \brief convert a value to a string
+ *
+ * Double quotes are handled specially. If the string begins and ends with quotes, they
+ * are removed. Otherwise, they are preserved.
+ */
+template <>
+inline bool kvparse::parse_value<string_view>(string_view text, string_view& res)
+{
+    res = text;
+	if(res.size() >= 1 && res[0] == '"' && res[res.size()-1] == '"') {
+		res = res.substr(1, res.size()-2);
+	}
+    return true;
+}
+
+template <>
+inline bool kvparse::parse_value<string>(string_view text, string& res)
+{
+    string_view unquoted;
+    parse_value(text, unquoted);
+    res.assign(unquoted.data(), unquoted.size());
+    return true;
+}
+
+/*!
+ * \brief convert a value of the form [-+]?\d+ to an integer
+ */
+template <>
+inline bool kvparse::parse_value<int>(string_view text, int& res)
+{
+    bool negative = false;
+    if(!text.empty() && (text[0] == '-' || text[0] == '+')) {
+        negative = (text[0] == '-');
+        text.remove_prefix(1);
+    }
+    long long x;
+    if(!all_digits(text) || std::from_chars(text.data(), text.data()+text.size(), x).ec != std::errc()) {
+        return false;
+    }
+    x = negative ? -x : x;
+    if(x < std::numeric_limits<int>::min() || x > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    res = (int)x;
+    return true;
+}
+
+/*!
+ * \brief convert a value of the form \+?\d+ to an unsigned long
+ */
+template <>
+inline bool kvparse::parse_value<unsigned long>(string_view text, unsigned long& res)
+{
+    if(!text.empty() && text[0] == '+') {
+        text.remove_prefix(1);
+    }
+    if(!all_digits(text) || std::from_chars(text.data(), text.data()+text.size(), res).ec != std::errc()) {
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief convert a value of the form \+?\d+ to an unsigned integer
+ */
+template <>
+inline bool kvparse::parse_value<unsigned int>(string_view text, unsigned int& res)
+{
+    unsigned long x;
+    if(!parse_value(text, x) || x > std::numeric_limits<unsigned int>::max()) {
+        return false;
+    }
+    res = (unsigned int)x;
+    return true;
+}
+
+/*!
+ * \brief convert a value of the form [-+]?\d*\.?\d* to a double
+ *
+ * As with atof, a value with no digits at all (e.g., "." or "-") is zero.
+ */
+template <>
+inline bool kvparse::parse_value<double>(string_view text, double& res)
+{
+    bool negative = false;
+    if(!text.empty() && (text[0] == '-' || text[0] == '+')) {
+        negative = (text[0] == '-');
+        text.remove_prefix(1);
+    }
+    string_view::size_type dot = text.find('.');
+    string_view whole = text.substr(0, dot);
+    string_view fraction = (dot == string_view::npos) ? string_view() : text.substr(dot+1);
+    if((!whole.empty() && !all_digits(whole)) || (!fraction.empty() && !all_digits(fraction))) {
+        return false;
+    }
+
+    double x = 0.0;
+    if(!whole.empty() || !fraction.empty()) {
+        std::from_chars(text.data(), text.data()+text.size(), x);
+    }
+    res = negative ? -x : x;
+    return true;
+}
+
+/*!
+ * \brief convert a value to a bool
+ */
+template <>
+inline bool kvparse::parse_value<bool>(string_view text, bool& res)
+{
+    if(text == "true" || text == "yes" || text == "TRUE" || text == "YES" || text == "1") {
+        res = true;
+    } else if(text == "false" || text == "no" || text == "FALSE" || text == "NO" || text == "0") {
+        res = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief extra detail appended to the message of an illegal_value_error
+ */
+template <typename T>
+inline string kvparse::value_hint()
+{
+    if constexpr (kvparse_named_enum<T>) {
+        return ". Must be one of " + kvparse_enum_table<T>::valid_names();
+    }
+    return string();
+}
+
+template <>
+inline string kvparse::value_hint<bool>()
+{
+    return ". Must be one of 'yes','true','no','false','0','1'";
+}
+
+/*!
+ * \brief convert the values found by a lookup to a single T without throwing
+ * \param keyword the keyword that was looked up
+ * \param values the keyword's values, or null if the lookup failed
+ * \param err the reason the lookup failed, if it did
+ *
+ * Values may be any container of string_views with size() and front(), so
+ * the same conversions serve the live database and frozen snapshots.
+ */
+template <typename T, typename Values>
+inline std::expected<T,kv_error> kvparse::convert(string_view keyword, const Values* values, kv_errc err)
+{
+    if(values == 0) {
+        return std::unexpected(kv_error(err, keyword));
+    }
+    if(values->size() != 1) {
+        return std::unexpected(kv_error(kv_errc::ambiguous_keyword, keyword));
+    }
+
+    T res;
+    if(!parse_value(values->front(), res)) {
+        return std::unexpected(kv_error(kv_errc::illegal_value, keyword));
+    }
+    return res;
+}
+
+/*!
+ * \brief get the primary value without throwing
+ * \param keyword the keyword to look up
+ * \return the converted value, or a kv_error describing why there is none
+ *
+ * This never throws and never allocates on failure, so it is suitable for
+ * probing optional keys on hot paths. The error refers to the keyword
+ * passed in and is only valid for as long as that string is.
+ */
+template <typename T>
+inline std::expected<T,kv_error> kvparse::try_get(string_view keyword)
+{
+    note_access(keyword);
+    if(thread_cache_.load(std::memory_order_relaxed)) {
+        return cached_get<T>(keyword);
+    }
+    return get_value<T>(keyword);
+}
+
+/*!
+ * \brief look up and convert the primary value, preferring one set at run time
+ */
+template <typename T>
+inline std::expected<T,kv_error> kvparse::get_value(string_view keyword)
+{
+    if(runtime_count_.load(std::memory_order_acquire) != 0) {
+        std::shared_ptr<const runtime_values> set = runtime_lookup(keyword);
+        if(set) {
+            return convert<T>(keyword, set->empty() ? 0 : set.get(), kv_errc::missing_keyword);
+        }
+    }
+    kv_errc err;
+    value_hold hold;
+    const value_list* values = lookup(keyword, &err, &hold);
+    return convert<T>(keyword, values, err);
+}
 
-public:
-    static void clear();
-    static bool read_configuration_file(const string &fileName);
-    static bool keyword_exists(const string &keyword);
-    static bool has_unique_value(const string &keyword);
-    static void dump_contents(ostream &ostr);
+/*!
+ * \brief get the primary value through the calling thread's cache
+ *
+ * Each thread keeps a small direct-mapped table, per type, from keyword
+ * hash to converted value. A slot is only trusted if it was filled at the
+ * current database version, so any change to the database invalidates
+ * every thread's cache at once without touching it. The version is read
+ * before the lookup, so a change that races with filling a slot leaves
+ * that slot stale rather than wrong. Failed lookups are not cached.
+ */
+template <typename T>
+inline std::expected<T,kv_error> kvparse::cached_get(string_view keyword)
+{
+    thread_local cache_slot<T> cache[cache_slots];
 
-    template <typename T>
-    static inline bool parameter_value(const string& keyword, T& value, bool required=false);
+    size_t hash = std::hash<string_view>()(keyword);
+    cache_slot<T>& slot = cache[hash % cache_slots];
+    uint64_t now = version_.load(std::memory_order_acquire);
+    if(slot.version == now && slot.hash == hash && slot.keyword == keyword) {
+        return slot.value;
+    }
 
-    template <typename T>
-    static inline bool parameter_value(const string& keyword, vector<T>& value, bool required=false);
+    std::expected<T,kv_error> val = get_value<T>(keyword);
+    if(val) {
+        slot.hash = hash;
+        slot.version = now;
+        slot.keyword.assign(keyword.data(), keyword.size());
+        slot.value = *val;
+    }
+    return val;
+}
 
-    template <typename T>
-    static inline bool parameter_value(const string& keyword, list<T>& value, bool required=false);
-};
+/*!
+ * \brief throw the exception corresponding to a failed lookup
+ */
+template <typename T>
+[[noreturn]] inline void kvparse::raise(const kv_error& err)
+{
+    string keyword(err.keyword);
+    switch(err.code) {
+    case kv_errc::missing_keyword:
+        throw missing_keyword_error("required keyword '"+keyword+"' not specified");
+    case kv_errc::ambiguous_keyword:
+        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+    case kv_errc::unresolved_reference:
+        throw illegal_value_error("keyword '"+keyword+"' refers to a keyword that is missing, has multiple values, or is not terminated by '}'");
+    case kv_errc::cyclic_reference:
+        throw illegal_value_error("keyword '"+keyword+"' is part of a cycle of ${} references");
+    default:
+        throw illegal_value_error("illegal value for keyword '"+keyword+"' specified"+value_hint<T>());
+    }
+}
 
 /*!
- * \brief get the primary value as a string
+ * \brief store the result of a non-throwing lookup, or throw its error
  *
- * Double quotes are handled specially. If the string begins and ends with quotes, they
- * are removed. Otherwise, they are preserved.
+ * Failures other than an optional keyword being absent are turned into
+ * exceptions.
  */
-template <>
-inline bool kvparse::parameter_value<string>(const string &keyword, string& res, bool required)
+template <typename T>
+inline bool kvparse::read_scalar(const std::expected<T,kv_error>& val, T& res, bool required)
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return false;
-        }
+    if(val) {
+        res = *val;
+        return true;
+    }
+    if(val.error().code == kv_errc::missing_keyword && !required) {
+        return false;
     }
+    raise<T>(val.error());
+}
 
-    if(!has_unique_value(keyword)) {
-        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+/*!
+ * \brief split the primary value on blanks and convert each token to a T
+ */
+template <typename T, typename Values>
+inline bool kvparse::read_list(string_view keyword, const Values* values, kv_errc err, list<T>& res, bool required)
+{
+    if(values == 0) {
+        if(err == kv_errc::missing_keyword && !required) {
+            return true;
+        }
+        raise<T>(kv_error(err, keyword));
     }
 
-    res=value(keyword);
-	if(res.size() >= 1 && res[0] == '"' && res[res.size()-1] == '"') {
-		res = res.substr(1, res.size()-2);
-		
-	}
+    res.clear();
+    string_view text = values->front();
+    for(;;) {
+        string_view::size_type blank = text.find_first_of(" \t");
+        res.push_back(from_string<T>(string(text.substr(0, blank))));
+        if(blank == string_view::npos) {
+            break;
+        }
+        text.remove_prefix(blank+1);
+    }
     return true;
 }
 
 /*!
- * \brief get the primary value as an integer
+ * \brief read the primary value as a whitespace-separated vector of Ts
  */
-template <>
-inline bool kvparse::parameter_value<int>(const string& keyword, int& res, bool required)
+template <typename T, typename Values>
+inline bool kvparse::read_vector(string_view keyword, const Values* values, kv_errc err, vector<T>& v, bool required)
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return false;
+    if(values == 0) {
+        if(err == kv_errc::missing_keyword && !required) {
+            return true;
         }
-    }
-    if(!has_unique_value(keyword)) {
-        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+        raise<T>(kv_error(err, keyword));
     }
 
-	boost::regex int_check("[-+]?\\d+");
-	if(!boost::regex_match(value(keyword), int_check)) {
-		throw illegal_value_error(keyword);
-	} else {
-		res=atoi(value(keyword).c_str());
-	}
-	
+    v.clear();
+    string vecvals = values->size() == 1 ? string(values->front()) : string();
+    istringstream istr(vecvals);
+    while(!istr.eof()) {
+        T x;
+        istr >> x;
+        v.push_back(x);
+    }
     return true;
 }
 
 /*!
- * \brief get the primary value as an unsigned integer
+ * \brief read the primary value as a matrix of Ts, one row per ';'
+ *
+ * Brackets around the value are optional, as is a ';' after the last row.
+ * Rows are counted and checked for equal length before anything is
+ * converted, so the elements go straight into a buffer sized once.
  */
-template <>
-inline bool kvparse::parameter_value<unsigned int>(const string& keyword, unsigned int& res, bool required)
+template <typename T, typename Values>
+inline bool kvparse::read_matrix(string_view keyword, const Values* values, kv_errc err, kvparse_matrix<T>& m, bool required)
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return false;
+    if(values == 0) {
+        if(err == kv_errc::missing_keyword && !required) {
+            return true;
         }
+        raise<T>(kv_error(err, keyword));
     }
-    if(!has_unique_value(keyword)) {
-        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+    if(values->size() != 1) {
+        raise<T>(kv_error(kv_errc::ambiguous_keyword, keyword));
     }
 
-	boost::regex uint_check("\\+?\\d+");
-	if(!boost::regex_match(value(keyword), uint_check)) {
-		throw illegal_value_error(keyword);
-	}
+    string_view text = values->front();
+    if(!text.empty() && text[0] == '[') {
+        if(text[text.size()-1] != ']') {
+            raise<T>(kv_error(kv_errc::illegal_value, keyword));
+        }
+        text = text.substr(1, text.size()-2);
+    }
+
+    // find the shape
+    size_t rows = 0;
+    size_t cols = 0;
+    for(string_view rest = text; ; ) {
+        string_view::size_type semicolon = rest.find(';');
+        kvparse_token_view row(rest.substr(0, semicolon));
+        size_t n = std::ranges::distance(row);
+        if(n != 0) {
+            if(rows != 0 && n != cols) {
+                throw illegal_value_error("keyword '"+string(keyword)+"' has rows of different lengths: row "+
+                                          std::to_string(rows+1)+" has "+std::to_string(n)+" values, not "+
+                                          std::to_string(cols));
+            }
+            cols = n;
+            rows++;
+        }
+        if(semicolon == string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(semicolon+1);
+    }
+    if(m.fixed_ && (rows != m.rows_ || cols != m.cols_)) {
+        throw illegal_value_error("keyword '"+string(keyword)+"' must be a "+std::to_string(m.rows_)+"x"+
+                                  std::to_string(m.cols_)+" matrix, not "+std::to_string(rows)+"x"+
+                                  std::to_string(cols));
+    }
 
-    string temp=value(keyword);
-	res = (unsigned int)atoi(temp.c_str());
+    // the rows have been checked, so ';' only separates tokens from here on
+    m.data_.resize(rows*cols);
+    size_t k = 0;
+    for(string_view rest = text; k < rows*cols; ) {
+        string_view::size_type semicolon = rest.find(';');
+        for(string_view token : kvparse_token_view(rest.substr(0, semicolon))) {
+            T x;
+            if(!parse_value(token, x)) {
+                raise<T>(kv_error(kv_errc::illegal_value, keyword));
+            }
+            m.data_[k++] = std::move(x);
+        }
+        rest.remove_prefix(semicolon+1);
+    }
+    m.rows_ = rows;
+    m.cols_ = cols;
     return true;
 }
 
 /*!
- * \brief get the primary value as an unsigned long
+ * \brief get the primary value as any supported scalar type
  */
-template <>
-inline bool kvparse::parameter_value<unsigned long>(const string& keyword, unsigned long& res, bool required)
+template <typename T>
+inline bool kvparse::parameter_value(const string& keyword, T& res, bool required)
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return false;
+    return read_scalar(try_get<T>(keyword), res, required);
+}
+
+/*!
+ * \brief retrieve parameter values as a list of the specified type
+ */
+template <typename T>
+inline bool kvparse::parameter_value(const string& keyword, list<T>& res, bool required)
+{
+    note_access(keyword);
+    if(runtime_count_.load(std::memory_order_acquire) != 0) {
+        std::shared_ptr<const runtime_values> set = runtime_lookup(keyword);
+        if(set) {
+            return read_list(keyword, set->empty() ? 0 : set.get(), kv_errc::missing_keyword, res, required);
         }
     }
-    if(!has_unique_value(keyword)) {
-        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+    kv_errc err;
+    value_hold hold;
+    const value_list* values = lookup(keyword, &err, &hold);
+    return read_list(keyword, values, err, res, required);
+}
+
+/*!
+ * \brief retrieve parameter values as a vector of a specified type
+ */
+template <class T>
+inline bool kvparse::parameter_value(const string& keyword, vector<T>& v, bool required)
+{
+    note_access(keyword);
+    if(runtime_count_.load(std::memory_order_acquire) != 0) {
+        std::shared_ptr<const runtime_values> set = runtime_lookup(keyword);
+        if(set) {
+            return read_vector(keyword, set->empty() ? 0 : set.get(), kv_errc::missing_keyword, v, required);
+        }
     }
+    kv_errc err;
+    value_hold hold;
+    const value_list* values = lookup(keyword, &err, &hold);
+    return read_vector(keyword, values, err, v, required);
+}
 
-	boost::regex uint_check("\\+?\\d+");
-	if(!boost::regex_match(value(keyword), uint_check)) {
-		throw illegal_value_error(keyword);
-	}
+/*!
+ * \brief retrieve a parameter value as a matrix of a specified type
+ */
+template <typename T>
+inline bool kvparse::parameter_value(const string& keyword, kvparse_matrix<T>& m, bool required)
+{
+    note_access(keyword);
+    if(runtime_count_.load(std::memory_order_acquire) != 0) {
+        std::shared_ptr<const runtime_values> set = runtime_lookup(keyword);
+        if(set) {
+            return read_matrix(keyword, set->empty() ? 0 : set.get(), kv_errc::missing_keyword, m, required);
+        }
+    }
+    kv_errc err;
+    value_hold hold;
+    const value_list* values = lookup(keyword, &err, &hold);
+    return read_matrix(keyword, values, err, m, required);
+}
 
-    string temp=value(keyword);
-	res = (unsigned long)atol(temp.c_str());
-    return true;
+/*!
+ * \brief find a keyword in a frozen database
+ * \return the keyword's entry, or null if it does not exist
+ */
+inline const kvparse_frozen::entry* kvparse_frozen::find(string_view keyword) const
+{
+    kvparse::note_access(keyword);
+    return locate(keyword);
 }
 
 /*!
- * \brief get the primary value as a double
+ * \brief find a keyword in the overlay of runtime changes, then in the copy
  */
-template <>
-inline bool kvparse::parameter_value<double>(const string& keyword, double& res, bool required)
+inline const kvparse_frozen::entry* kvparse_frozen::locate(string_view keyword) const
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return false;
+    if(base_) {
+        overlay_map::const_iterator o = overlay_->find(keyword);
+        if(o != overlay_->end()) {
+            return o->second->removed ? 0 : &o->second->e;
         }
+        return base_->locate(keyword);
     }
-    if(!has_unique_value(keyword)) {
-        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+    if(slots_.empty()) {
+        return 0;
     }
+    return probe(keyword, hash(keyword));
+}
 
-	boost::regex double_check("[-+]?\\d*\\.?\\d*");
-	if(!boost::regex_match(value(keyword), double_check)) {
-		throw illegal_value_error(keyword);
-	}
+/*!
+ * \brief walk the index from a keyword's home slot until it or an empty slot is found
+ * \param keyword
+ * \param h the keyword's hash
+ *
+ * The index must not be empty.
+ */
+inline const kvparse_frozen::entry* kvparse_frozen::probe(string_view keyword, size_t h) const
+{
+    size_t mask = slots_.size()-1;
+    for(size_t i=h & mask; ; i=(i+1) & mask) {
+        const slot& s = slots_[i];
+        if(s.index == 0) {
+            return 0;
+        }
+        if(s.tag == (uint32_t)(h >> 32) && entries_[s.index-1].keyword == keyword) {
+            return &entries_[s.index-1];
+        }
+    }
+}
 
-    string temp=value(keyword);
-    res=atof(temp.c_str());
-    return true;
+/*!
+ * \brief find up to batch keywords at once
+ * \param keywords the keywords to find
+ * \param found set to each keyword's entry, or null if it does not exist
+ * \param n the number of keywords, at most batch
+ *
+ * Every keyword is hashed and its index slot prefetched before any slot is
+ * read, then every candidate entry and its keyword text is prefetched
+ * before any is compared, so the cache misses of the whole batch overlap
+ * instead of being paid one after another.
+ */
+inline void kvparse_frozen::find_many(const string_view* keywords, const entry** found, size_t n) const
+{
+    if(base_) {
+        base_->find_many(keywords, found, n);
+        for(size_t i=0; i<n; i++) {
+            overlay_map::const_iterator o = overlay_->find(keywords[i]);
+            if(o != overlay_->end()) {
+                found[i] = o->second->removed ? 0 : &o->second->e;
+            }
+        }
+        return;
+    }
+    size_t h[batch];
+    const slot* first[batch];
+    if(slots_.empty()) {
+        std::fill(found, found+n, (const entry*)0);
+        return;
+    }
+    size_t mask = slots_.size()-1;
+    for(size_t i=0; i<n; i++) {
+        h[i] = hash(keywords[i]);
+        first[i] = &slots_[h[i] & mask];
+        __builtin_prefetch(first[i]);
+    }
+    for(size_t i=0; i<n; i++) {
+        if(first[i]->index != 0) {
+            __builtin_prefetch(&entries_[first[i]->index-1]);
+        }
+    }
+    for(size_t i=0; i<n; i++) {
+        if(first[i]->index != 0) {
+            __builtin_prefetch(entries_[first[i]->index-1].keyword.data());
+        }
+    }
+    for(size_t i=0; i<n; i++) {
+        kvparse::note_access(keywords[i]);
+        found[i] = probe(keywords[i], h[i]);
+    }
 }
 
 /*!
- * \brief get the primary value as a bool
+ * \brief look up the values of a keyword in a frozen database
+ * \param keyword
+ * \param err set to the reason if there are no values to return
+ * \return the keyword's entry, or null if the keyword does not exist or
+ *         its ${...} references could not be expanded when it was frozen
  */
-template <>
-inline bool kvparse::parameter_value<bool>(const string& keyword, bool& res, bool required)
+inline const kvparse_frozen::entry* kvparse_frozen::lookup(string_view keyword, kv_errc* err) const
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return false;
+    const entry* e = find(keyword);
+    if(e == 0) {
+        *err = kv_errc::missing_keyword;
+        return 0;
+    }
+    if(!e->valid) {
+        *err = e->error;
+        return 0;
+    }
+    return e;
+}
+
+/*!
+ * \brief visit every entry whose keyword begins with the given prefix
+ * \param visit callable invoked as visit(string_view keyword, const entry& values)
+ */
+template <typename F>
+inline void kvparse_frozen::for_each_with_prefix(string_view prefix, F visit) const
+{
+    if(base_) {
+        // merge the changed keywords into a walk over the copy
+        const kvparse_frozen& copy = *base_;
+        overlay_map::const_iterator o = overlay_->lower_bound(prefix);
+        vector<uint32_t>::const_iterator iter = std::lower_bound(copy.sorted_.begin(), copy.sorted_.end(), prefix,
+            [&](uint32_t e, string_view k) { return copy.entries_[e].keyword < k; });
+        for(; iter!=copy.sorted_.end() && copy.entries_[*iter].keyword.starts_with(prefix); ++iter) {
+            const entry& e = copy.entries_[*iter];
+            bool replaced = false;
+            for(; o!=overlay_->end() && o->first <= e.keyword; ++o) {
+                replaced = replaced || o->first == e.keyword;
+                if(!o->second->removed) {
+                    visit(o->first, o->second->e);
+                }
+            }
+            if(!replaced) {
+                visit(e.keyword, e);
+            }
+        }
+        for(; o!=overlay_->end() && o->first.starts_with(prefix); ++o) {
+            if(!o->second->removed) {
+                visit(o->first, o->second->e);
+            }
         }
+        return;
     }
-    if(!has_unique_value(keyword)) {
-        throw ambiguous_keyword_error("keyword '"+keyword+"' is ambiguous; multiple values");
+    vector<uint32_t>::const_iterator iter = std::lower_bound(sorted_.begin(), sorted_.end(), prefix,
+        [&](uint32_t e, string_view k) { return entries_[e].keyword < k; });
+    for(; iter!=sorted_.end() && entries_[*iter].keyword.starts_with(prefix); ++iter) {
+        visit(entries_[*iter].keyword, entries_[*iter]);
     }
+}
 
-    string temp = value(keyword);
-    if(temp == "true" || temp == "yes" || temp == "TRUE" || temp == "YES" || temp == "1") {
-        res = true;
-    } else if(temp == "false" || temp == "no" || temp == "FALSE" || temp == "NO" || temp == "0") {
-        res = false;
-    } else {
-		throw illegal_value_error("illegal value for keyword '"+keyword+"' specified. Must be one of 'yes','true','no','false','0','1'");
+inline bool kvparse_snapshot::keyword_exists(const string& keyword) const
+{
+    return db_->find(keyword) != 0;
+}
+
+inline bool kvparse_snapshot::has_unique_value(const string& keyword) const
+{
+    const kvparse_frozen::entry* e = db_->find(keyword);
+    return e != 0 && e->size() == 1;
+}
+
+/*!
+ * \brief every value of a keyword, contiguous in the snapshot
+ * \return empty if the keyword is missing or its references could not be expanded
+ */
+inline std::span<const string_view> kvparse_snapshot::values(string_view keyword) const
+{
+    kv_errc err;
+    const kvparse_frozen::entry* e = db_->lookup(keyword, &err);
+    return e ? std::span<const string_view>(e->first, e->count) : std::span<const string_view>();
+}
+
+/*!
+ * \brief the whitespace-separated tokens of every value of a keyword
+ *
+ * Token boundaries are found once, when the snapshot is made, so this is
+ * a single lookup.
+ */
+inline std::span<const string_view> kvparse_snapshot::tokens(string_view keyword) const
+{
+    kv_errc err;
+    const kvparse_frozen::entry* e = db_->lookup(keyword, &err);
+    return e ? std::span<const string_view>(e->first_token, e->token_count) : std::span<const string_view>();
+}
+
+/*!
+ * \brief look up many keywords at once
+ * \param keywords the keywords to find
+ * \param found set to each keyword's entry, or null if it does not exist;
+ *        must be at least as long as keywords
+ *
+ * The keywords are resolved kvparse_frozen::batch at a time with their
+ * cache misses overlapped, so a batch costs about as much as one cold
+ * lookup. Entries whose ${...} references could not be expanded are
+ * returned too; check entry::valid.
+ */
+inline void kvparse_snapshot::lookup_many(std::span<const string_view> keywords,
+                                          std::span<const kvparse_frozen::entry*> found) const
+{
+    if(found.size() < keywords.size()) {
+        throw std::runtime_error("lookup_many: fewer output slots than keywords");
+    }
+    for(size_t base=0; base<keywords.size(); base+=kvparse_frozen::batch) {
+        size_t n = std::min(kvparse_frozen::batch, keywords.size()-base);
+        db_->find_many(keywords.data()+base, found.data()+base, n);
     }
-    return true;
 }
 
 /*!
- * \brief retrieve parameter values as a list of the specified type
+ * \brief look up and convert the primary values of many keywords at once
+ * \param keywords the keywords to read
+ * \param values set to each converted value, or the reason there is none,
+ *        as try_get would; must be at least as long as keywords
+ *
+ * All the lookups are done as by lookup_many before anything is
+ * converted.
  */
 template <typename T>
-inline bool kvparse::parameter_value(const string& keyword, list<T>& res, bool required)
+inline void kvparse_snapshot::get_many(std::span<const string_view> keywords,
+                                       std::span<std::expected<T,kv_error> > values) const
 {
-    if(keyword_exists(keyword)) {
-		list<string> vals = values(keyword);
-        res.clear();
-        for(list<string>::iterator it=vals.begin(); it!=vals.end(); ++it) {
-			res.push_back(from_string<T>(*it));
-		}
-        return true;
-    } else {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return true;
+    if(values.size() < keywords.size()) {
+        throw std::runtime_error("get_many: fewer output slots than keywords");
+    }
+    const kvparse_frozen::entry* found[kvparse_frozen::batch];
+    for(size_t base=0; base<keywords.size(); base+=kvparse_frozen::batch) {
+        size_t n = std::min(kvparse_frozen::batch, keywords.size()-base);
+        db_->find_many(keywords.data()+base, found, n);
+        for(size_t i=0; i<n; i++) {
+            kv_errc err = kv_errc::missing_keyword;
+            const kvparse_frozen::entry* e = found[i];
+            if(e != 0 && !e->valid) {
+                err = e->error;
+                e = 0;
+            }
+            values[base+i] = kvparse::convert<T>(keywords[base+i], e, err);
         }
     }
-    return false;
 }
 
 /*!
- * \brief retrieve parameter values as a vector of a specified type
+ * \brief read many keywords at once from the current version
+ *
+ * Runtime changes publish themselves as an overlay on the current frozen
+ * version, so this is normally snapshot().get_many(keywords, values)
+ * with its batched, prefetched probes. It never freezes the database,
+ * though: after a load, until a snapshot has been taken, each keyword is
+ * read from the live database as try_get would.
  */
-template <class T>
-inline bool kvparse::parameter_value(const string& keyword, vector<T>& v, bool required)
+template <typename T>
+inline void kvparse::get_many(std::span<const string_view> keywords, std::span<std::expected<T,kv_error> > values)
 {
-    if(!keyword_exists(keyword)) {
-        if(required) {
-            throw missing_keyword_error("required keyword '"+keyword+"' not specified");
-        } else {
-            return true;
-        }
-	} else {
-        v.clear();
-        string vecvals = value(keyword);
-        istringstream istr(vecvals);
-        while(!istr.eof()) {
-            T x;
-            istr >> x;
-            v.push_back(x);
-        }
+    std::shared_ptr<const kvparse_frozen> current = published_frozen();
+    if(current) {
+        kvparse_snapshot(current).get_many(keywords, values);
+        return;
     }
-    return true;
+    if(values.size() < keywords.size()) {
+        throw std::runtime_error("get_many: fewer output slots than keywords");
+    }
+    for(size_t i=0; i<keywords.size(); i++) {
+        values[i] = try_get<T>(keywords[i]);
+    }
+}
+
+template <typename T>
+inline std::expected<T,kv_error> kvparse_snapshot::try_get(string_view keyword) const
+{
+    kv_errc err;
+    const kvparse_frozen::entry* values = db_->lookup(keyword, &err);
+    return kvparse::convert<T>(keyword, values, err);
+}
+
+template <typename T>
+inline bool kvparse_snapshot::parameter_value(const string& keyword, T& res, bool required) const
+{
+    return kvparse::read_scalar(try_get<T>(keyword), res, required);
+}
+
+template <typename T>
+inline bool kvparse_snapshot::parameter_value(const string& keyword, list<T>& res, bool required) const
+{
+    kv_errc err;
+    const kvparse_frozen::entry* values = db_->lookup(keyword, &err);
+    return kvparse::read_list(keyword, values, err, res, required);
+}
+
+template <typename T>
+inline bool kvparse_snapshot::parameter_value(const string& keyword, vector<T>& v, bool required) const
+{
+    kv_errc err;
+    const kvparse_frozen::entry* values = db_->lookup(keyword, &err);
+    return kvparse::read_vector(keyword, values, err, v, required);
+}
+
+template <typename T>
+inline bool kvparse_snapshot::parameter_value(const string& keyword, kvparse_matrix<T>& m, bool required) const
+{
+    kv_errc err;
+    const kvparse_frozen::entry* values = db_->lookup(keyword, &err);
+    return kvparse::read_matrix(keyword, values, err, m, required);
+}
+
+inline const kvparse_shared::image_entry* kvparse_shared::find(string_view keyword) const
+{
+    const image_entry* first = entries();
+    const image_entry* last = first+header()->entry_count;
+    const image_entry* e = std::lower_bound(first, last, keyword,
+        [this](const image_entry& x, string_view k) { return keyword_of(&x) < k; });
+    if(e == last || keyword_of(e) != keyword) {
+        return 0;
+    }
+    return e;
+}
+
+inline bool kvparse_shared::keyword_exists(const string& keyword) const
+{
+    return find(keyword) != 0;
+}
+
+inline bool kvparse_shared::has_unique_value(const string& keyword) const
+{
+    const image_entry* e = find(keyword);
+    return e != 0 && e->count == 1;
+}
+
+/*!
+ * \brief visit every entry whose keyword begins with the given prefix
+ * \param visit callable invoked as visit(string_view keyword, const kvparse_shared::values& values)
+ */
+template <typename F>
+inline void kvparse_shared::for_each_with_prefix(const string& prefix, F visit) const
+{
+    const image_entry* last = entries()+header()->entry_count;
+    const image_entry* e = std::lower_bound(entries(), last, string_view(prefix),
+        [this](const image_entry& x, string_view k) { return keyword_of(&x) < k; });
+    for(; e!=last && keyword_of(e).starts_with(prefix); ++e) {
+        visit(keyword_of(e), values(image_, e));
+    }
+}
+
+template <typename T>
+inline std::expected<T,kv_error> kvparse_shared::try_get(string_view keyword) const
+{
+    const image_entry* e = find(keyword);
+    if(e == 0) {
+        return std::unexpected(kv_error(kv_errc::missing_keyword, keyword));
+    }
+    if(!e->valid) {
+        return std::unexpected(kv_error(static_cast<kv_errc>(e->error), keyword));
+    }
+    values v(image_, e);
+    return kvparse::convert<T>(keyword, &v, kv_errc::missing_keyword);
+}
+
+template <typename T>
+inline bool kvparse_shared::parameter_value(const string& keyword, T& res, bool required) const
+{
+    return kvparse::read_scalar(try_get<T>(keyword), res, required);
+}
+
+template <typename T>
+inline bool kvparse_shared::parameter_value(const string& keyword, list<T>& res, bool required) const
+{
+    const image_entry* e = find(keyword);
+    if(e == 0 || !e->valid) {
+        kv_errc err = e ? static_cast<kv_errc>(e->error) : kv_errc::missing_keyword;
+        return kvparse::read_list(keyword, (const values*)0, err, res, required);
+    }
+    values v(image_, e);
+    return kvparse::read_list(keyword, &v, kv_errc::missing_keyword, res, required);
+}
+
+template <typename T>
+inline bool kvparse_shared::parameter_value(const string& keyword, vector<T>& res, bool required) const
+{
+    const image_entry* e = find(keyword);
+    if(e == 0 || !e->valid) {
+        kv_errc err = e ? static_cast<kv_errc>(e->error) : kv_errc::missing_keyword;
+        return kvparse::read_vector(keyword, (const values*)0, err, res, required);
+    }
+    values v(image_, e);
+    return kvparse::read_vector(keyword, &v, kv_errc::missing_keyword, res, required);
+}
+
+template <typename T>
+inline bool kvparse_shared::parameter_value(const string& keyword, kvparse_matrix<T>& res, bool required) const
+{
+    const image_entry* e = find(keyword);
+    if(e == 0 || !e->valid) {
+        kv_errc err = e ? static_cast<kv_errc>(e->error) : kv_errc::missing_keyword;
+        return kvparse::read_matrix(keyword, (const values*)0, err, res, required);
+    }
+    values v(image_, e);
+    return kvparse::read_matrix(keyword, &v, kv_errc::missing_keyword, res, required);
 }
 
 /*!
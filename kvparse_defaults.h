@@ -0,0 +1,261 @@
+// Copyright 2013 Deon Garrett <deon@iiim.is>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _KVPARSE_DEFAULTS_H_
+#define _KVPARSE_DEFAULTS_H_
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include "kvparse.h"
+
+/*!
+ * \brief reached only when embedded defaults fail to parse
+ *
+ * Deliberately not constexpr and never defined: evaluating a call to it
+ * while parsing defaults at compile time stops compilation, with this
+ * function's name in the diagnostic.
+ */
+void kvparse_embedded_syntax_error_see_defaults_text();
+
+/*!
+ * \brief one keyword/value pair from compiled-in defaults
+ *
+ * The value is kept as written, and is also classified and converted
+ * with the same rules parameter_value uses, so the table can be checked
+ * with static_assert.
+ */
+struct kvparse_default_entry
+{
+    enum value_kind { string_value, integer_value, real_value, boolean_value };
+
+    string_view keyword;
+    string_view value;
+    value_kind kind;
+    long long integer;
+    double real;
+    bool boolean;
+};
+
+/*!
+ * \brief split configuration text into keyword/value pairs at compile time
+ * \param visit called as visit(keyword, value) for every entry, in order
+ *
+ * Follows the runtime parser for single-line entries: '#' starts a
+ * comment, blank lines are skipped, the delimiter is the first ':' or else
+ * the first '=', keywords and values are trimmed of blanks, tabs and
+ * carriage returns, keywords must be identifiers and values must not be
+ * empty. Unlike the runtime parser, a bracketed value must close on the
+ * line it opens on, since the table refers to the text in place and has
+ * nowhere to keep rows joined from several lines; write "m: [1 0; 0 1]"
+ * rather than spreading the rows out. A '[' left open is a compile error.
+ */
+template <typename F>
+constexpr void kvparse_scan_defaults(string_view text, F visit)
+{
+    constexpr string_view blanks = " \r\t";
+    while(!text.empty()) {
+        string_view line = text.substr(0, text.find('\n'));
+        text.remove_prefix(line.size() < text.size() ? line.size()+1 : line.size());
+
+        line = line.substr(0, line.find('#'));
+        if(line.find_first_not_of(" \r\t\f\v") == string_view::npos) {
+            continue;
+        }
+
+        string_view::size_type delimiter = line.find(':');
+        if(delimiter == string_view::npos) {
+            delimiter = line.find('=');
+        }
+        if(delimiter == string_view::npos) {
+            kvparse_embedded_syntax_error_see_defaults_text();
+        }
+
+        string_view keyword = line.substr(0, delimiter);
+        string_view value = line.substr(delimiter+1);
+        if(keyword.find_first_not_of(blanks) == string_view::npos ||
+           value.find_first_not_of(blanks) == string_view::npos) {
+            kvparse_embedded_syntax_error_see_defaults_text();
+        }
+        keyword = keyword.substr(keyword.find_first_not_of(blanks));
+        keyword = keyword.substr(0, keyword.find_last_not_of(blanks)+1);
+        value = value.substr(value.find_first_not_of(blanks));
+        value = value.substr(0, value.find_last_not_of(blanks)+1);
+        if(value[0] == '[' && value.find(']') == string_view::npos) {
+            kvparse_embedded_syntax_error_see_defaults_text();
+        }
+
+        // [A-Za-z_][A-Za-z0-9_.-]*'*
+        string_view::size_type primes = keyword.find_last_not_of('\'')+1;
+        for(string_view::size_type i=0; i<primes; i++) {
+            char c = keyword[i];
+            bool alpha = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+            bool rest = (c >= '0' && c <= '9') || c == '.' || c == '-';
+            if(!(alpha || (i > 0 && rest))) {
+                kvparse_embedded_syntax_error_see_defaults_text();
+            }
+        }
+        if(primes == 0) {
+            kvparse_embedded_syntax_error_see_defaults_text();
+        }
+
+        visit(keyword, value);
+    }
+}
+
+//! the number of entries in configuration text, for sizing kvparse_defaults
+consteval size_t kvparse_count_defaults(string_view text)
+{
+    size_t n = 0;
+    kvparse_scan_defaults(text, [&](string_view, string_view) { n++; });
+    return n;
+}
+
+/*!
+ * \class kvparse_defaults
+ *
+ * A table of default settings parsed from configuration text while the
+ * program is compiled. Build one with KVPARSE_DEFAULTS, which sizes the
+ * table, and load it with kvparse::read_defaults or read_layer_defaults;
+ * loading inserts the entries directly, with no parsing and no copies of
+ * the text. Malformed text is a compile error.
+ *
+ *     constexpr string_view default_text =
+ *         "population_size: 100\n"
+ *         "mutation.rate: 0.01\n";
+ *     constexpr auto defaults = KVPARSE_DEFAULTS(default_text);
+ *     static_assert(defaults.find("population_size")->integer == 100);
+ */
+template <size_t N>
+class kvparse_defaults
+{
+public:
+    typedef kvparse_default_entry entry;
+
+    consteval explicit kvparse_defaults(string_view text) : entries_() {
+        size_t n = 0;
+        kvparse_scan_defaults(text, [&](string_view keyword, string_view value) {
+            entries_[n++] = classify(keyword, value);
+        });
+        if(n != N) {
+            kvparse_embedded_syntax_error_see_defaults_text();
+        }
+    }
+
+    constexpr size_t size() const { return N; }
+    constexpr const entry* begin() const { return entries_.data(); }
+    constexpr const entry* end() const { return entries_.data()+N; }
+
+    //! the first entry for a keyword, or null
+    constexpr const entry* find(string_view keyword) const {
+        for(const entry& e : entries_) {
+            if(e.keyword == keyword) {
+                return &e;
+            }
+        }
+        return 0;
+    }
+
+private:
+    std::array<entry, N> entries_;
+
+    static constexpr bool digits(string_view s) {
+        for(char c : s) {
+            if(c < '0' || c > '9') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static constexpr entry classify(string_view keyword, string_view value) {
+        entry e = { keyword, value, entry::string_value, 0, 0.0, false };
+
+        string_view unsigned_part = value;
+        bool negative = false;
+        if(unsigned_part[0] == '-' || unsigned_part[0] == '+') {
+            negative = (unsigned_part[0] == '-');
+            unsigned_part.remove_prefix(1);
+        }
+        string_view::size_type dot = unsigned_part.find('.');
+        string_view whole = unsigned_part.substr(0, dot);
+        string_view fraction = dot == string_view::npos ? string_view() : unsigned_part.substr(dot+1);
+
+        if(!whole.empty() && dot == string_view::npos && digits(whole)) {
+            e.kind = entry::integer_value;
+            for(char c : whole) {
+                e.integer = e.integer*10 + (c-'0');
+            }
+            e.integer = negative ? -e.integer : e.integer;
+            e.real = (double)e.integer;
+        } else if(dot != string_view::npos && (!whole.empty() || !fraction.empty()) &&
+                  digits(whole) && digits(fraction)) {
+            e.kind = entry::real_value;
+            double scale = 1.0;
+            for(char c : whole) {
+                e.real = e.real*10 + (c-'0');
+            }
+            for(char c : fraction) {
+                scale /= 10;
+                e.real += (c-'0')*scale;
+            }
+            e.real = negative ? -e.real : e.real;
+        } else if(value == "true" || value == "yes" || value == "TRUE" || value == "YES") {
+            e.kind = entry::boolean_value;
+            e.boolean = true;
+        } else if(value == "false" || value == "no" || value == "FALSE" || value == "NO") {
+            e.kind = entry::boolean_value;
+            e.boolean = false;
+        }
+        return e;
+    }
+};
+
+//! parse configuration text at compile time into a kvparse_defaults table
+#define KVPARSE_DEFAULTS(text) kvparse_defaults<kvparse_count_defaults(text)>(text)
+
+/*!
+ * \brief load compiled-in defaults as if they had been read from a file
+ * \return true
+ *
+ * The database refers to the text the defaults were built from, which has
+ * static storage, so nothing is parsed or copied.
+ */
+template <size_t N>
+inline bool kvparse::read_defaults(const kvparse_defaults<N>& defaults)
+{
+    return load_direct([&](database& db) {
+        for(const kvparse_default_entry& e : defaults) {
+            add_value(db, e.keyword, e.value, true);
+        }
+        return true;
+    });
+}
+
+/*!
+ * \brief load compiled-in defaults into a layer, e.g., one below all others
+ * \param layer_name a layer previously created with define_layer
+ */
+template <size_t N>
+inline bool kvparse::read_layer_defaults(const string& layer_name, const kvparse_defaults<N>& defaults)
+{
+    return load_layer(layer_name, [&](database& db) {
+        for(const kvparse_default_entry& e : defaults) {
+            add_value(db, e.keyword, e.value, true);
+        }
+        return true;
+    });
+}
+
+#endif
@@ -17,6 +17,40 @@
 
 #include <stdexcept>
 #include <string>
+#include <string_view>
+
+/*!
+ * \brief reasons a lookup can fail
+ *
+ * The reference errors describe values containing ${...} that cannot be
+ * expanded; they are reported as illegal_value_error when thrown.
+ */
+enum class kv_errc
+{
+	missing_keyword,
+	ambiguous_keyword,
+	illegal_value,
+	unresolved_reference,
+	cyclic_reference
+};
+
+/*!
+ * \struct kv_error
+ * \brief error returned by the non-throwing lookup functions
+ *
+ * Holds a reference to the keyword that was looked up rather than a copy,
+ * so building one never allocates.
+ */
+struct kv_error
+{
+	kv_errc code;
+	std::string_view keyword;
+
+	kv_error(kv_errc c, std::string_view k) :
+		code(c), keyword(k)
+		{
+		}
+};
 
 /*!
  * \class missing_keyword
@@ -0,0 +1,172 @@
+// kvparse_loadgen: measures kvparsed throughput and latency
+//
+//     kvparse_loadgen socket_path [requests] [pipeline_depth] [keys_per_request]
+//
+// The keywords to ask for are discovered with a single prefix request for
+// everything. Requests are then kept pipeline_depth deep on one connection,
+// and the time from sending each request to receiving its response is
+// recorded.
+
+#include "kvparse_protocol.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+typedef std::chrono::steady_clock bench_clock;
+
+int connect_to(const string& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        perror("kvparse_loadgen: connect");
+        exit(1);
+    }
+    return fd;
+}
+
+void send_all(int fd, const string& data)
+{
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = write(fd, data.data()+sent, data.size()-sent);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            perror("kvparse_loadgen: write");
+            exit(1);
+        }
+        sent += n;
+    }
+}
+
+/*!
+ * \brief block until at least one more response has arrived
+ * \param consumed bytes of in decoded by the previous call; the responses
+ *        refer into in, so they are only discarded on the next call
+ * \return the number of complete responses decoded into res
+ */
+size_t receive(int fd, string& in, size_t& consumed, vector<kvparse_protocol::response>& res)
+{
+    in.erase(0, consumed);
+    res.clear();
+    size_t used = 0;
+    for(;;) {
+        kvparse_protocol::response r;
+        size_t n;
+        while((n = kvparse_protocol::decode_response(string_view(in).substr(used), r)) > 0) {
+            used += n;
+            res.push_back(r);
+        }
+        if(!res.empty()) {
+            break;
+        }
+        char buf[65536];
+        ssize_t got = read(fd, buf, sizeof(buf));
+        if(got < 0 && errno == EINTR) {
+            continue;
+        }
+        if(got <= 0) {
+            fprintf(stderr, "kvparse_loadgen: connection closed\n");
+            exit(1);
+        }
+        in.append(buf, got);
+    }
+    consumed = used;
+    return res.size();
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s socket_path [requests] [pipeline_depth] [keys_per_request]\n", argv[0]);
+        return 2;
+    }
+    long requests = argc > 2 ? atol(argv[2]) : 200000;
+    long depth = argc > 3 ? atol(argv[3]) : 16;
+    long batch = argc > 4 ? atol(argv[4]) : 8;
+    if(requests <= 0 || depth <= 0 || batch < 1 || batch > 65535) {
+        fprintf(stderr, "%s: requests and pipeline_depth must be positive, and keys_per_request "
+                "between 1 and 65535\n", argv[0]);
+        return 2;
+    }
+    int fd = connect_to(argv[1]);
+
+    // discover the keywords
+    string out, in;
+    size_t consumed = 0;
+    vector<kvparse_protocol::response> res;
+    kvparse_protocol::encode_request(out, 0, kvparse_protocol::prefix, vector<string_view>(1, ""));
+    send_all(fd, out);
+    receive(fd, in, consumed, res);
+    vector<string> keywords;
+    for(unsigned int i=0; i<res[0].entries.size(); i++) {
+        keywords.push_back(string(res[0].entries[i].keyword));
+    }
+    if(keywords.empty()) {
+        fprintf(stderr, "kvparse_loadgen: the daemon has no keywords\n");
+        return 1;
+    }
+
+    vector<bench_clock::time_point> sent_at(requests);
+    vector<double> latency;
+    latency.reserve(requests);
+    long next = 0;
+    size_t cursor = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    while((long)latency.size() < requests) {
+        // top the pipeline up
+        out.clear();
+        while(next < requests && next-(long)latency.size() < depth) {
+            vector<string_view> keys;
+            for(long k=0; k<batch; k++) {
+                keys.push_back(keywords[cursor++ % keywords.size()]);
+            }
+            kvparse_protocol::encode_request(out, next, kvparse_protocol::get, keys);
+            sent_at[next++] = bench_clock::now();
+        }
+        send_all(fd, out);
+
+        receive(fd, in, consumed, res);
+        bench_clock::time_point now = bench_clock::now();
+        for(unsigned int i=0; i<res.size(); i++) {
+            if(res[i].status != kvparse_protocol::ok || (long)res[i].entries.size() != batch) {
+                fprintf(stderr, "kvparse_loadgen: bad response to request %u\n", res[i].id);
+                return 1;
+            }
+            latency.push_back(std::chrono::duration<double,std::micro>(now - sent_at[res[i].id]).count());
+        }
+    }
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    close(fd);
+
+    std::sort(latency.begin(), latency.end());
+    printf("%ld requests of %ld keys, pipeline depth %ld, %zu keywords\n", requests, batch, depth, keywords.size());
+    printf("%-12s %12.0f\n", "requests/s", requests/elapsed);
+    printf("%-12s %12.0f\n", "keys/s", requests*batch/elapsed);
+    printf("%-12s %12.1f us\n", "p50", latency[latency.size()/2]);
+    printf("%-12s %12.1f us\n", "p99", latency[latency.size()*99/100]);
+    printf("%-12s %12.1f us\n", "max", latency.back());
+    return 0;
+}
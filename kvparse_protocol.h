@@ -0,0 +1,277 @@
+// Copyright 2013 Deon Garrett <deon@iiim.is>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _KVPARSE_PROTOCOL_H_
+#define _KVPARSE_PROTOCOL_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include "kvparse.h"
+
+/*!
+ * \class kvparse_protocol
+ *
+ * The binary protocol spoken by kvparsed over its Unix domain socket.
+ * Integers are in host byte order, since both ends are on the same host.
+ *
+ * A request is one frame:
+ *
+ *     u32 length      bytes following this field
+ *     u32 id          echoed in the response
+ *     u8  op          get or prefix
+ *     u16 count       number of keys
+ *     count x { u16 size, bytes }
+ *
+ * and is answered by one frame, in the order the requests were sent:
+ *
+ *     u32 length
+ *     u32 id
+ *     u8  status      ok, or bad_request if the frame could not be decoded
+ *     u64 version     version of the configuration that answered
+ *     u32 count       number of entries
+ *     count x { u8 code, u16 size, keyword bytes, u32 nvalues,
+ *               nvalues x { u32 size, bytes } }
+ *
+ * A get produces one entry per key, in order; code is 0 if the key was
+ * found and 1 + kv_errc otherwise. A prefix produces one entry for every
+ * keyword beginning with each of the given prefixes. Values are sent with
+ * any ${...} references already expanded. Clients may send any number of
+ * requests before reading the responses.
+ */
+class kvparse_protocol
+{
+public:
+    enum opcode : uint8_t { get = 1, prefix = 2 };
+    enum status : uint8_t { ok = 0, bad_request = 1 };
+
+    //! frames larger than this are rejected rather than buffered
+    static const uint32_t max_frame = 16*1024*1024;
+
+    //! one keyword and its values from a response
+    struct entry
+    {
+        uint8_t code;
+        string_view keyword;
+        vector<string_view> values;
+    };
+
+    //! a decoded response; the views refer to the buffer it was decoded from
+    struct response
+    {
+        uint32_t id;
+        uint8_t status;
+        uint64_t version;
+        vector<entry> entries;
+    };
+
+    static void encode_request(string& out, uint32_t id, opcode op, const vector<string_view>& keys);
+    static size_t serve(string_view in, const kvparse_snapshot& db, string& out, bool* malformed);
+    static size_t decode_response(string_view in, response& res);
+
+private:
+    template <typename T>
+    static void put(string& out, T x) {
+        out.append(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+
+    template <typename T>
+    static bool take(string_view& in, T& x) {
+        if(in.size() < sizeof(x)) {
+            return false;
+        }
+        memcpy(&x, in.data(), sizeof(x));
+        in.remove_prefix(sizeof(x));
+        return true;
+    }
+
+    template <typename Size>
+    static bool take_bytes(string_view& in, string_view& bytes) {
+        Size n;
+        if(!take(in, n) || in.size() < n) {
+            return false;
+        }
+        bytes = in.substr(0, n);
+        in.remove_prefix(n);
+        return true;
+    }
+
+    template <typename Values>
+    static void put_entry(string& out, uint8_t code, string_view keyword, const Values* values) {
+        put<uint8_t>(out, code);
+        put<uint16_t>(out, keyword.size());
+        out.append(keyword);
+        put<uint32_t>(out, values ? values->size() : 0);
+        if(values) {
+            for(const string_view& v : *values) {
+                put<uint32_t>(out, v.size());
+                out.append(v);
+            }
+        }
+    }
+
+    static bool answer(string_view frame, const kvparse_snapshot& db, string& out);
+};
+
+/*!
+ * \brief append a request frame to a buffer
+ */
+inline void kvparse_protocol::encode_request(string& out, uint32_t id, opcode op, const vector<string_view>& keys)
+{
+    size_t start = out.size();
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, id);
+    put<uint8_t>(out, op);
+    put<uint16_t>(out, keys.size());
+    for(unsigned int i=0; i<keys.size(); i++) {
+        put<uint16_t>(out, keys[i].size());
+        out.append(keys[i]);
+    }
+    uint32_t length = out.size()-start-sizeof(uint32_t);
+    memcpy(&out[start], &length, sizeof(length));
+}
+
+/*!
+ * \brief answer every complete request frame at the front of a buffer
+ * \param in bytes received so far
+ * \param db the configuration to answer from
+ * \param out responses are appended here
+ * \param malformed set if a frame announced a length over max_frame, in
+ *        which case the stream cannot be resynchronized
+ * \return the number of bytes consumed; any partial frame is left over
+ */
+inline size_t kvparse_protocol::serve(string_view in, const kvparse_snapshot& db, string& out, bool* malformed)
+{
+    size_t consumed = 0;
+    *malformed = false;
+    for(;;) {
+        string_view rest = in.substr(consumed);
+        uint32_t length;
+        if(!take(rest, length)) {
+            break;
+        }
+        if(length > max_frame) {
+            *malformed = true;
+            break;
+        }
+        if(rest.size() < length) {
+            break;
+        }
+        size_t mark = out.size();
+        if(!answer(rest.substr(0, length), db, out)) {
+            // reply with an empty error frame, echoing the id if there is one
+            out.resize(mark);
+            uint32_t id = 0;
+            if(length >= sizeof(id)) {
+                memcpy(&id, rest.data(), sizeof(id));
+            }
+            put<uint32_t>(out, sizeof(uint32_t)+sizeof(uint8_t)+sizeof(uint64_t)+sizeof(uint32_t));
+            put<uint32_t>(out, id);
+            put<uint8_t>(out, bad_request);
+            put<uint64_t>(out, db.version());
+            put<uint32_t>(out, 0);
+        }
+        consumed += sizeof(length)+length;
+    }
+    return consumed;
+}
+
+/*!
+ * \brief answer a single request frame (without its length field)
+ * \return false if the frame is malformed
+ */
+inline bool kvparse_protocol::answer(string_view frame, const kvparse_snapshot& db, string& out)
+{
+    uint32_t id;
+    uint8_t op;
+    uint16_t count;
+    if(!take(frame, id) || !take(frame, op) || !take(frame, count) || (op != get && op != prefix)) {
+        return false;
+    }
+
+    size_t start = out.size();
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, id);
+    put<uint8_t>(out, ok);
+    put<uint64_t>(out, db.version());
+    size_t count_at = out.size();
+    put<uint32_t>(out, 0);
+
+    uint32_t entries = 0;
+    for(unsigned int i=0; i<count; i++) {
+        string_view key;
+        if(!take_bytes<uint16_t>(frame, key)) {
+            return false;
+        }
+        if(op == get) {
+            kv_errc err = kv_errc::missing_keyword;
+            const kvparse_frozen::entry* values = db.lookup(key, &err);
+            put_entry(out, values ? 0 : 1+static_cast<uint8_t>(err), key, values);
+            entries++;
+        } else {
+            db.for_each_with_prefix(string(key), [&](string_view keyword, const kvparse_frozen::entry& values) {
+                put_entry(out, values.valid ? 0 : 1+static_cast<uint8_t>(values.error), keyword, &values);
+                entries++;
+            });
+        }
+    }
+    if(!frame.empty()) {
+        return false;
+    }
+
+    uint32_t length = out.size()-start-sizeof(uint32_t);
+    memcpy(&out[start], &length, sizeof(length));
+    memcpy(&out[count_at], &entries, sizeof(entries));
+    return true;
+}
+
+/*!
+ * \brief decode the response frame at the front of a buffer
+ * \return the number of bytes consumed, or 0 if the frame is not complete
+ *
+ * Throws runtime_error if the frame is complete but malformed.
+ */
+inline size_t kvparse_protocol::decode_response(string_view in, response& res)
+{
+    uint32_t length;
+    if(!take(in, length) || in.size() < length) {
+        return 0;
+    }
+    string_view frame = in.substr(0, length);
+    uint32_t count;
+    if(!take(frame, res.id) || !take(frame, res.status) || !take(frame, res.version) || !take(frame, count) ||
+       count > frame.size()) {
+        throw std::runtime_error("malformed kvparse response");
+    }
+    res.entries.resize(count);
+    for(unsigned int i=0; i<count; i++) {
+        entry& e = res.entries[i];
+        uint32_t nvalues;
+        if(!take(frame, e.code) || !take_bytes<uint16_t>(frame, e.keyword) || !take(frame, nvalues) ||
+           nvalues > frame.size()) {
+            throw std::runtime_error("malformed kvparse response");
+        }
+        e.values.resize(nvalues);
+        for(unsigned int j=0; j<nvalues; j++) {
+            if(!take_bytes<uint32_t>(frame, e.values[j])) {
+                throw std::runtime_error("malformed kvparse response");
+            }
+        }
+    }
+    return sizeof(length)+length;
+}
+
+#endif
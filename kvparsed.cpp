@@ -0,0 +1,240 @@
+// kvparsed: serves a configuration to local clients over a Unix domain socket
+//
+//     kvparsed socket_path config_file [config_file...]
+//
+// The files are read in order, as with repeated calls to
+// read_configuration_file. Requests use the protocol in kvparse_protocol.h.
+// On SIGHUP the files are read again; if that fails, the previous
+// configuration stays in service. SIGINT and SIGTERM remove the socket and
+// exit.
+
+#include "kvparse.h"
+#include "kvparse_protocol.h"
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+volatile sig_atomic_t reload_requested = 0;
+volatile sig_atomic_t stop_requested = 0;
+
+void on_signal(int sig)
+{
+    if(sig == SIGHUP) {
+        reload_requested = 1;
+    } else {
+        stop_requested = 1;
+    }
+}
+
+/*!
+ * \brief read all the configuration files and freeze the result
+ *
+ * Throws on any error; the caller decides whether to keep serving the
+ * previous snapshot. The daemon makes no runtime changes and keeps no
+ * override log; one that did would have to reopen it after the files are
+ * read, since clear() closes it and drops the runtime values.
+ */
+kvparse_snapshot load(const vector<string>& files)
+{
+    kvparse::clear();
+    for(unsigned int i=0; i<files.size(); i++) {
+        kvparse::read_configuration_file(files[i]);
+    }
+    return kvparse::snapshot();
+}
+
+// stop reading a client's requests while this many reply bytes are
+// waiting for it to read, so a client that pipelines without reading
+// cannot grow the daemon without bound
+const size_t output_limit = 1 << 20;
+
+struct connection
+{
+    int fd;
+    string in;
+    string out;
+};
+
+int listen_on(const string& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "kvparsed: socket path too long: %s\n", path.c_str());
+        return -1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        perror("kvparsed: listen");
+        return -1;
+    }
+    return fd;
+}
+
+/*!
+ * \brief read what is available, answer complete requests, write replies
+ * \return false if the connection should be closed
+ */
+bool service(connection& c, const kvparse_snapshot& db)
+{
+    char buf[65536];
+    while(c.out.size() < output_limit) {
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if(n > 0) {
+            c.in.append(buf, n);
+
+            // answer every pipelined request received so far in one pass
+            bool malformed;
+            size_t used = kvparse_protocol::serve(c.in, db, c.out, &malformed);
+            c.in.erase(0, used);
+            if(malformed) {
+                return false;
+            }
+            continue;
+        }
+        if(n == 0) {
+            return false;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        return false;
+    }
+
+    while(!c.out.empty()) {
+        ssize_t n = write(c.fd, c.out.data(), c.out.size());
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if(n < 0) {
+            return false;
+        }
+        c.out.erase(0, n);
+    }
+    return true;
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s socket_path config_file [config_file...]\n", argv[0]);
+        return 2;
+    }
+    string path = argv[1];
+    vector<string> files(argv+2, argv+argc);
+
+    kvparse_snapshot db = kvparse::snapshot();
+    try {
+        db = load(files);
+    } catch(std::exception& e) {
+        fprintf(stderr, "kvparsed: %s\n", e.what());
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGHUP, &sa, 0);
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    // signals are only delivered while waiting in ppoll, so none is missed
+    // between checking the flags and going to sleep
+    sigset_t blocked, waiting;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, &waiting);
+
+    int listener = listen_on(path);
+    if(listener < 0) {
+        return 1;
+    }
+    fprintf(stderr, "kvparsed: serving %zu keywords on %s\n", db.size(), path.c_str());
+
+    vector<connection> clients;
+    vector<pollfd> fds;
+    while(!stop_requested) {
+        if(reload_requested) {
+            reload_requested = 0;
+            try {
+                db = load(files);
+                fprintf(stderr, "kvparsed: reloaded %zu keywords\n", db.size());
+            } catch(std::exception& e) {
+                fprintf(stderr, "kvparsed: reload failed, keeping the previous configuration: %s\n", e.what());
+            }
+        }
+
+        fds.clear();
+        pollfd p = { listener, POLLIN, 0 };
+        fds.push_back(p);
+        for(unsigned int i=0; i<clients.size(); i++) {
+            short events = (clients[i].out.size() < output_limit ? POLLIN : 0) |
+                           (clients[i].out.empty() ? 0 : POLLOUT);
+            pollfd q = { clients[i].fd, events, 0 };
+            fds.push_back(q);
+        }
+        if(ppoll(fds.data(), fds.size(), 0, &waiting) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("kvparsed: ppoll");
+            break;
+        }
+
+        // walk backwards so closed connections can be removed in place
+        for(int i=(int)clients.size()-1; i>=0; i--) {
+            if(fds[i+1].revents == 0) {
+                continue;
+            }
+            if(!service(clients[i], db)) {
+                close(clients[i].fd);
+                clients[i] = clients.back();
+                clients.pop_back();
+            }
+        }
+        if(fds[0].revents & POLLIN) {
+            int fd;
+            while((fd = accept4(listener, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                connection c;
+                c.fd = fd;
+                clients.push_back(c);
+            }
+        }
+    }
+
+    for(unsigned int i=0; i<clients.size(); i++) {
+        close(clients[i].fd);
+    }
+    close(listener);
+    unlink(path.c_str());
+    return 0;
+}
@@ -1,12 +1,34 @@
 #include "kvparse.h"
 #include "kvparse_except.h"
+#include "kvparse_protocol.h"
+#include "kvparse_defaults.h"
 #include <gtest/gtest.h>
 #include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <zlib.h>
 
 using std::string;
 using std::vector;
 using std::runtime_error;
 
+enum class test_selection { tournament, roulette, truncation, steady_state };
+
+template <>
+struct kvparse_enum_names<test_selection>
+{
+	static constexpr std::array<std::pair<string_view,test_selection>,4> names = {{
+		{ "tournament", test_selection::tournament },
+		{ "roulette", test_selection::roulette },
+		{ "truncation", test_selection::truncation },
+		{ "steady_state", test_selection::steady_state },
+	}};
+};
+
 namespace {
 
 class basic_parse_test : public ::testing::Test 
@@ -63,6 +85,1634 @@ TEST(basic_parse_test, syntax_invalid_identifiers)
 	EXPECT_THROW(kvparse::read_configuration_file("tests/test_config9.cfg"), syntax_error);
 }
 
+TEST(basic_parse_test, prefix_scan)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config10.cfg");
+
+	vector<string> keys;
+	kvparse::for_each_with_prefix("mutation.", [&](string_view k, const kvparse::value_list& v) {
+		keys.push_back(string(k));
+		EXPECT_EQ(1u, v.size());
+	});
+	ASSERT_EQ(3u, keys.size());
+	EXPECT_EQ("mutation.bits", keys[0]);
+	EXPECT_EQ("mutation.operator", keys[1]);
+	EXPECT_EQ("mutation.rate", keys[2]);
+
+	int n = 0;
+	kvparse::for_each_with_prefix("selection.", [&](string_view, const kvparse::value_list&) { n++; });
+	EXPECT_EQ(0, n);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, subconfig_view)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config10.cfg");
+
+	kvparse_section mutation = kvparse::subconfig("mutation.");
+	double rate = 0;
+	string op;
+	vector<int> bits;
+	EXPECT_TRUE(mutation.parameter_value("rate", rate));
+	EXPECT_DOUBLE_EQ(0.025, rate);
+	EXPECT_TRUE(mutation.parameter_value("operator", op));
+	EXPECT_EQ("swap", op);
+	mutation.parameter_value("bits", bits);
+	ASSERT_EQ(3u, bits.size());
+	EXPECT_EQ(3, bits[2]);
+	EXPECT_FALSE(mutation.keyword_exists("s"));
+	EXPECT_THROW(mutation.parameter_value("size", rate, true), missing_keyword_error);
+
+	vector<string> keys;
+	mutation.for_each([&](string_view k, const kvparse::value_list&) { keys.push_back(string(k)); });
+	ASSERT_EQ(3u, keys.size());
+	EXPECT_EQ("bits", keys[0]);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, interning_test_configs)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config1.cfg");
+	kvparse::intern_stats st = kvparse::interning_stats();
+	EXPECT_GT(st.unique, 0u);
+	EXPECT_LT(st.unique, st.references);
+	EXPECT_LE(st.bytes_stored, st.bytes_referenced);
+	EXPECT_GT(st.dedup_ratio(), 1.0);
+
+	kvparse::clear();
+	st = kvparse::interning_stats();
+	EXPECT_EQ(0u, st.references);
+	EXPECT_EQ(0u, st.unique);
+}
+
+TEST(basic_parse_test, interning_synthetic_corpus)
+{
+	const char* choices[] = { "true", "0", "tournament", "steady_state", "../prob/qap/gar60uni1.dat" };
+	string fname = ::testing::TempDir() + "kvparse_intern.cfg";
+	{
+		std::ofstream out(fname.c_str());
+		for(int i=0; i<10000; i++) {
+			out << "key" << (i % 500) << ": " << choices[i % 5] << "\n";
+		}
+	}
+
+	kvparse::clear();
+	kvparse::read_configuration_file(fname);
+	kvparse::intern_stats st = kvparse::interning_stats();
+	EXPECT_EQ(20000u, st.references);
+	EXPECT_EQ(505u, st.unique);
+	EXPECT_GT(st.dedup_ratio(), 35.0);
+	EXPECT_GT(st.bytes_saved(), 50000u);
+
+	EXPECT_TRUE(kvparse::keyword_exists("key499"));
+	EXPECT_FALSE(kvparse::has_unique_value("key0"));
+	kvparse::clear();
+	std::remove(fname.c_str());
+}
+
+TEST(basic_parse_test, async_load)
+{
+	kvparse::clear();
+	std::future<bool> loaded = kvparse::read_configuration_file_async("tests/test_config1.cfg");
+	EXPECT_TRUE(loaded.get());
+
+	int ivalue;
+	kvparse::parameter_value("integer2", ivalue);
+	EXPECT_EQ(2, ivalue);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, async_load_errors)
+{
+	std::future<bool> bad = kvparse::read_configuration_file_async("tests/test_config2.cfg");
+	EXPECT_THROW(bad.get(), syntax_error);
+
+	std::future<bool> missing = kvparse::read_configuration_file_async("tests/no_such_file.cfg");
+	EXPECT_THROW(missing.get(), runtime_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, async_load_batch_preserves_order)
+{
+	vector<string> files;
+	files.push_back("tests/test_config11.cfg");
+	files.push_back("tests/test_config10.cfg");
+
+	kvparse::clear();
+	kvparse::read_configuration_files_async(files).get();
+	EXPECT_TRUE(kvparse::keyword_exists("mutation.rate"));
+	EXPECT_FALSE(kvparse::has_unique_value("metric"));
+
+	list<string> metric;
+	kvparse::parameter_value("metric", metric);
+	ASSERT_FALSE(metric.empty());
+	EXPECT_EQ("generation_counter", metric.front());
+
+	files.push_back("tests/test_config3.cfg");
+	kvparse::clear();
+	EXPECT_THROW(kvparse::read_configuration_files_async(files).get(), syntax_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, no_trailing_newline)
+{
+	int ivalue = 0;
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config12.cfg");
+	EXPECT_TRUE(kvparse::parameter_value("last", ivalue));
+	EXPECT_EQ(12, ivalue);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, incremental_feed_any_split)
+{
+	const string text = "mutation.rate: 0.025\r\nmutation.operator = swap # comment\n\n  metric: a\nmetric: b";
+	for(unsigned int split=0; split<=text.size(); split++) {
+		kvparse::clear();
+		kvparse_incremental_parser parser("split");
+		parser.feed(text.data(), split);
+		parser.feed(text.data()+split, text.size()-split);
+		// the unterminated last line is held back until finish()
+		EXPECT_FALSE(kvparse::keyword_exists("metric") && !kvparse::has_unique_value("metric"));
+		parser.finish();
+
+		string op;
+		EXPECT_TRUE(kvparse::parameter_value("mutation.operator", op));
+		EXPECT_EQ("swap", op);
+		EXPECT_FALSE(kvparse::has_unique_value("metric"));
+	}
+
+	kvparse::clear();
+	kvparse_incremental_parser parser;
+	for(unsigned int i=0; i<text.size(); i++) {
+		parser.feed(text.data()+i, 1);
+	}
+	parser.finish();
+	double rate = 0;
+	kvparse::parameter_value("mutation.rate", rate);
+	EXPECT_DOUBLE_EQ(0.025, rate);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, incremental_feed_syntax_error)
+{
+	kvparse::clear();
+	kvparse_incremental_parser parser("pipe");
+	const char text[] = "good: 1\nbad line\n";
+	EXPECT_THROW(parser.feed(text, sizeof(text)-1), syntax_error);
+	EXPECT_TRUE(kvparse::keyword_exists("good"));
+
+	kvparse_incremental_parser parser2("pipe");
+	parser2.feed("keyword =", 9);
+	EXPECT_THROW(parser2.finish(), syntax_error);
+	kvparse::clear();
+}
+
+// an asynchronous byte source that hands out one chunk each time the
+// test resumes the waiting coroutine
+struct chunked_source
+{
+	vector<string> chunks;
+	unsigned int next;
+	std::coroutine_handle<> waiting;
+
+	struct awaiter
+	{
+		chunked_source* src;
+		bool await_ready() { return false; }
+		void await_suspend(std::coroutine_handle<> h) { src->waiting = h; }
+		string_view await_resume() {
+			return src->next < src->chunks.size() ? string_view(src->chunks[src->next++]) : string_view();
+		}
+	};
+	awaiter read_some() { awaiter a = { this }; return a; }
+};
+
+TEST(basic_parse_test, incremental_feed_coroutine)
+{
+	kvparse::clear();
+	chunked_source src;
+	src.chunks.push_back("population_si");
+	src.chunks.push_back("ze: 100\ntournament_size: 2\ncross");
+	src.chunks.push_back("over_rate: 0.95");
+	src.next = 0;
+
+	kvparse_incremental_parser parser("supervisor");
+	kvparse_feed_task task = parser.feed_from(src);
+	int resumed = 0;
+	while(!task.done()) {
+		src.waiting.resume();
+		resumed++;
+	}
+	task.get();
+	EXPECT_EQ(4, resumed);
+
+	int ivalue = 0;
+	double dvalue = 0;
+	kvparse::parameter_value("population_size", ivalue);
+	EXPECT_EQ(100, ivalue);
+	kvparse::parameter_value("crossover_rate", dvalue);
+	EXPECT_DOUBLE_EQ(0.95, dvalue);
+
+	chunked_source bad;
+	bad.chunks.push_back("no delimiter\n");
+	bad.next = 0;
+	kvparse_feed_task failed = parser.feed_from(bad);
+	while(!failed.done()) {
+		bad.waiting.resume();
+	}
+	EXPECT_THROW(failed.get(), syntax_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, buffer_copied)
+{
+	kvparse::clear();
+	string text = "population_size: 100\nselection_operator = tournament # inline\nreference_point: 0 0";
+	kvparse::read_configuration_buffer(text, "defaults");
+	text.assign(text.size(), 'x');
+
+	int ivalue = 0;
+	string svalue;
+	vector<int> vivalue;
+	kvparse::parameter_value("population_size", ivalue);
+	EXPECT_EQ(100, ivalue);
+	kvparse::parameter_value("selection_operator", svalue);
+	EXPECT_EQ("tournament", svalue);
+	kvparse::parameter_value("reference_point", vivalue);
+	EXPECT_EQ(2u, vivalue.size());
+
+	EXPECT_THROW(kvparse::read_configuration_buffer("keyword =\n", "defaults"), syntax_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, buffer_borrowed)
+{
+	static const char defaults[] = "selection_operator: tournament\ntournament_size: 2\n";
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer(defaults, "defaults", kvparse::borrow_buffer);
+	EXPECT_EQ(0u, kvparse::interning_stats().unique);
+
+	bool found = false;
+	kvparse::for_each_with_prefix("selection_operator", [&](string_view k, const kvparse::value_list& v) {
+		EXPECT_EQ(defaults, k.data());
+		EXPECT_EQ("tournament", v.front());
+		found = true;
+	});
+	EXPECT_TRUE(found);
+
+	int ivalue = 0;
+	kvparse::parameter_value("tournament_size", ivalue);
+	EXPECT_EQ(2, ivalue);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, stream)
+{
+	kvparse::clear();
+	std::istringstream in("crossover_rate: 0.95\nmetric: a\nmetric: b\n");
+	kvparse::read_configuration_stream(in);
+
+	double dvalue = 0;
+	kvparse::parameter_value("crossover_rate", dvalue);
+	EXPECT_DOUBLE_EQ(0.95, dvalue);
+	EXPECT_FALSE(kvparse::has_unique_value("metric"));
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, layers_precedence)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config11.cfg");
+
+	kvparse::define_layer("cli", 40);
+	kvparse::define_layer("defaults", 10);
+	kvparse::define_layer("file", 20);
+	kvparse::define_layer("env", 30);
+
+	kvparse::read_layer_buffer("defaults", "mutation.rate: 0.5\nmutation.operator: swap\ntrials: 1\n", "defaults");
+	kvparse::read_layer_file("file", "tests/test_config10.cfg");
+	setenv("KVTEST_mutation__operator", "inversion", 1);
+	setenv("KVTEST_trials", " 8 ", 1);
+	EXPECT_EQ(2, kvparse::read_layer_environment("env", "KVTEST_"));
+	const char* argv[] = { "prog", "--trials=30", "positional", "-x", "--metric=best_found" };
+	EXPECT_EQ(2, kvparse::read_layer_arguments("cli", 5, argv));
+
+	double rate = 0;
+	string op;
+	int trials = 0;
+	kvparse::parameter_value("mutation.rate", rate);
+	EXPECT_DOUBLE_EQ(0.025, rate);
+	kvparse::parameter_value("mutation.operator", op);
+	EXPECT_EQ("inversion", op);
+	kvparse::parameter_value("trials", trials);
+	EXPECT_EQ(30, trials);
+	EXPECT_TRUE(kvparse::has_unique_value("metric"));
+
+	EXPECT_EQ("file", kvparse::source_layer("mutation.rate"));
+	EXPECT_EQ("env", kvparse::source_layer("mutation.operator"));
+	EXPECT_EQ("cli", kvparse::source_layer("trials"));
+	EXPECT_EQ("", kvparse::source_layer("no_such_key"));
+
+	// lowering the command line below the environment changes the winner
+	kvparse::define_layer("cli", 25);
+	kvparse::parameter_value("trials", trials);
+	EXPECT_EQ(8, trials);
+
+	// directly loaded files land in the base layer, below everything else
+	kvparse::clear_layer("file");
+	kvparse::clear_layer("cli");
+	kvparse::read_configuration_buffer("metric: generation_counter\nextra: 1\n");
+	EXPECT_EQ("base", kvparse::source_layer("metric"));
+	EXPECT_FALSE(kvparse::has_unique_value("metric"));
+	EXPECT_EQ("base", kvparse::source_layer("extra"));
+	kvparse::parameter_value("mutation.rate", rate);
+	EXPECT_DOUBLE_EQ(0.5, rate);
+
+	EXPECT_THROW(kvparse::read_layer_file("nonexistent", "tests/test_config10.cfg"), runtime_error);
+	const char* badargv[] = { "prog", "--1bad=3" };
+	EXPECT_THROW(kvparse::read_layer_arguments("cli", 2, badargv), syntax_error);
+
+	unsetenv("KVTEST_mutation__operator");
+	unsetenv("KVTEST_trials");
+	kvparse::clear();
+	EXPECT_EQ("", kvparse::source_layer("trials"));
+}
+
+TEST(basic_parse_test, interpolation)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config13.cfg");
+
+	string svalue;
+	kvparse::parameter_value("output_dir", svalue);
+	EXPECT_EQ("/data/run_3", svalue);
+	kvparse::parameter_value("log_file", svalue);
+	EXPECT_EQ("/data/run_3/log.txt", svalue);
+
+	vector<string> paths;
+	kvparse::parameter_value("paths", paths);
+	ASSERT_EQ(2u, paths.size());
+	EXPECT_EQ("/data/b", paths[1]);
+
+	// repeated reads hand back the same memoized expansion
+	std::expected<string_view,kv_error> first = kvparse::try_get<string_view>("log_file");
+	std::expected<string_view,kv_error> second = kvparse::try_get<string_view>("log_file");
+	ASSERT_TRUE(first.has_value() && second.has_value());
+	EXPECT_EQ(first->data(), second->data());
+
+	EXPECT_EQ(kv_errc::cyclic_reference, kvparse::try_get<string>("cycle_a").error().code);
+	EXPECT_EQ(kv_errc::unresolved_reference, kvparse::try_get<string>("dangling").error().code);
+	EXPECT_EQ(kv_errc::unresolved_reference, kvparse::try_get<string>("unterminated").error().code);
+	EXPECT_EQ(kv_errc::unresolved_reference, kvparse::try_get<string>("multi_ref").error().code);
+	EXPECT_THROW(kvparse::parameter_value("cycle_b", svalue), illegal_value_error);
+
+	// a second value for trial makes everything downstream of it unresolvable
+	kvparse::read_configuration_buffer("trial: 4\n");
+	EXPECT_EQ(kv_errc::unresolved_reference, kvparse::try_get<string>("log_file").error().code);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, interpolation_after_layer_change)
+{
+	kvparse::clear();
+	kvparse::define_layer("defaults", 0);
+	kvparse::define_layer("override", 10);
+	kvparse::read_layer_file("defaults", "tests/test_config13.cfg");
+
+	string svalue;
+	kvparse::parameter_value("log_file", svalue);
+	EXPECT_EQ("/data/run_3/log.txt", svalue);
+
+	kvparse::read_layer_buffer("override", "base_dir: /scratch\nunrelated: 1\n");
+	kvparse::parameter_value("log_file", svalue);
+	EXPECT_EQ("/scratch/run_3/log.txt", svalue);
+
+	kvparse::clear_layer("override");
+	kvparse::parameter_value("log_file", svalue);
+	EXPECT_EQ("/data/run_3/log.txt", svalue);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, interpolation_storage)
+{
+	kvparse::clear();
+	kvparse::define_layer("defaults", 0);
+	kvparse::define_layer("override", 10);
+	kvparse::read_layer_buffer("defaults", "base: /a\nout: ${base}/x\n");
+
+	// a view keeps the expansion it refers to alive after it is discarded
+	kvparse_value_view out = kvparse::values("out");
+	kvparse::read_layer_buffer("override", "base: /b\n");
+	EXPECT_EQ("/a/x", out.front());
+	EXPECT_EQ("/b/x", kvparse::values("out").front());
+
+	// expansions are not interned, so re-expanding adds nothing to the pool
+	kvparse::intern_stats before = kvparse::interning_stats();
+	for(int i=0; i<10; i++) {
+		kvparse::clear_layer("override");
+		EXPECT_EQ("/a/x", kvparse::values("out").front());
+	}
+	kvparse::intern_stats after = kvparse::interning_stats();
+	EXPECT_EQ(before.references, after.references);
+	EXPECT_EQ(before.unique, after.unique);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, snapshot_pins_version)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 100\ntournament_size: 2\ncrossover_rate: 0.9\nmetric: a b\n");
+
+	kvparse_snapshot before = kvparse::snapshot();
+	kvparse_snapshot again = kvparse::snapshot();
+	EXPECT_EQ(before.version(), again.version());
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 500\ntournament_size: 7\n");
+	kvparse_snapshot after = kvparse::snapshot();
+	EXPECT_NE(before.version(), after.version());
+
+	int ivalue = 0;
+	double dvalue = 0;
+	list<string> lsvalue;
+	before.parameter_value("population_size", ivalue);
+	EXPECT_EQ(100, ivalue);
+	before.parameter_value("tournament_size", ivalue);
+	EXPECT_EQ(2, ivalue);
+	before.parameter_value("crossover_rate", dvalue);
+	EXPECT_DOUBLE_EQ(0.9, dvalue);
+	before.parameter_value("metric", lsvalue);
+	EXPECT_EQ(2u, lsvalue.size());
+
+	after.parameter_value("population_size", ivalue);
+	EXPECT_EQ(500, ivalue);
+	EXPECT_FALSE(after.keyword_exists("crossover_rate"));
+	EXPECT_THROW(after.parameter_value("crossover_rate", dvalue, true), missing_keyword_error);
+	EXPECT_EQ(kv_errc::missing_keyword, after.try_get<double>("crossover_rate").error().code);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, snapshot_errors_and_prefixes)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config13.cfg");
+	kvparse::read_configuration_file("tests/test_config10.cfg");
+	kvparse_snapshot snap = kvparse::snapshot();
+	kvparse::clear();
+
+	string svalue;
+	snap.parameter_value("log_file", svalue);
+	EXPECT_EQ("/data/run_3/log.txt", svalue);
+	EXPECT_EQ(kv_errc::cyclic_reference, snap.try_get<string>("cycle_a").error().code);
+	EXPECT_TRUE(snap.keyword_exists("dangling"));
+	EXPECT_THROW(snap.parameter_value("metric", svalue), ambiguous_keyword_error);
+
+	vector<string> keys;
+	snap.for_each_with_prefix("mutation.", [&](string_view k, const kvparse_frozen::entry& v) {
+		keys.push_back(string(k));
+		EXPECT_EQ(1u, v.size());
+	});
+	ASSERT_EQ(3u, keys.size());
+	EXPECT_EQ("mutation.rate", keys[2]);
+}
+
+TEST(basic_parse_test, snapshot_runtime_overlay)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("a.one: 1\na.two: 2\na.three: 3\nother: x\n");
+	kvparse_snapshot before = kvparse::snapshot();
+
+	kvparse::set_value("a.two", "20");
+	kvparse::set_value("a.four", "4");
+	kvparse::remove_value("a.three", "3");
+	kvparse_snapshot after = kvparse::snapshot();
+
+	// the loaded values are not copied again for runtime changes
+	EXPECT_EQ(before.values("other").data(), after.values("other").data());
+	EXPECT_EQ(before.size(), after.size());
+	EXPECT_EQ(kvparse::version(), after.version());
+
+	// each snapshot keeps its own version
+	EXPECT_EQ(2, *before.try_get<int>("a.two"));
+	EXPECT_EQ(20, *after.try_get<int>("a.two"));
+	EXPECT_TRUE(before.keyword_exists("a.three"));
+	EXPECT_FALSE(after.keyword_exists("a.three"));
+	EXPECT_EQ(4, *after.try_get<int>("a.four"));
+	EXPECT_EQ(1u, after.tokens("a.four").size());
+
+	vector<string> keys;
+	after.for_each_with_prefix("a.", [&](string_view k, const kvparse_frozen::entry& v) {
+		keys.push_back(string(k) + "=" + string(v.front()));
+	});
+	vector<string> expected = { "a.four=4", "a.one=1", "a.two=20" };
+	EXPECT_EQ(expected, keys);
+
+	// a later change publishes over the same copy
+	kvparse::append_value("a.two", "21");
+	kvparse_snapshot latest = kvparse::snapshot();
+	EXPECT_EQ(2u, latest.values("a.two").size());
+	EXPECT_EQ(1u, after.values("a.two").size());
+	EXPECT_EQ(before.values("other").data(), latest.values("other").data());
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, numa_replicas)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config13.cfg");
+	kvparse::read_configuration_file("tests/test_config10.cfg");
+	kvparse_snapshot single = kvparse::snapshot();
+	EXPECT_EQ(0u, kvparse::numa_replicas());
+
+	kvparse::set_numa_replicas(true);
+	kvparse_snapshot local = kvparse::snapshot();
+	EXPECT_EQ(single.version(), local.version());
+	ASSERT_EQ(single.size(), local.size());
+	if(kvparse::numa_replicas() > 0) {
+		// served from a separate copy
+		EXPECT_NE(single.values("log_file").data(), local.values("log_file").data());
+	}
+
+	// the copy carries the expanded values, errors and tokens
+	string svalue;
+	local.parameter_value("log_file", svalue);
+	EXPECT_EQ("/data/run_3/log.txt", svalue);
+	EXPECT_EQ(kv_errc::cyclic_reference, local.try_get<string>("cycle_a").error().code);
+	EXPECT_THROW(local.parameter_value("metric", svalue), ambiguous_keyword_error);
+	single.for_each_with_prefix("", [&](string_view k, const kvparse_frozen::entry& v) {
+		if(!v.valid) {
+			return;
+		}
+		std::span<const string_view> values = local.values(k);
+		std::span<const string_view> tokens = local.tokens(k);
+		EXPECT_TRUE(std::ranges::equal(v, values));
+		EXPECT_TRUE(std::ranges::equal(std::span<const string_view>(v.first_token, v.token_count), tokens));
+	});
+
+	// a reload reaches the replicas
+	kvparse::read_configuration_buffer("population_size: 100\n");
+	int ivalue = 0;
+	EXPECT_TRUE(kvparse::snapshot().parameter_value("population_size", ivalue));
+	EXPECT_EQ(100, ivalue);
+
+	kvparse::set_numa_replicas(false);
+	EXPECT_EQ(0u, kvparse::numa_replicas());
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, runtime_values)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 100\nmetric: a\nmetric: b\n");
+	int ivalue = 0;
+
+	// a runtime value replaces the file's
+	kvparse::set_value("population_size", "250");
+	EXPECT_TRUE(kvparse::parameter_value("population_size", ivalue));
+	EXPECT_EQ(250, ivalue);
+	kvparse::set_value("new_key", " 7 ");
+	EXPECT_TRUE(kvparse::parameter_value("new_key", ivalue, true));
+	EXPECT_EQ(7, ivalue);
+	vector<int> vvalue;
+	EXPECT_TRUE(kvparse::parameter_value("new_key", vvalue, true));
+	EXPECT_EQ(vector<int>(1, 7), vvalue);
+
+	// appending keeps the existing values
+	EXPECT_EQ(3, kvparse::append_value("metric", "c"));
+	EXPECT_FALSE(kvparse::has_unique_value("metric"));
+	EXPECT_EQ(2, kvparse::remove_value("metric", "a"));
+	EXPECT_EQ(0, kvparse::remove_value("metric", "no_such_value"));
+	EXPECT_EQ(1, kvparse::remove_value("metric", "b"));
+	EXPECT_TRUE(kvparse::has_unique_value("metric"));
+	string svalue;
+	EXPECT_TRUE(kvparse::parameter_value("metric", svalue));
+	EXPECT_EQ("c", svalue);
+
+	// removing the last value removes the keyword
+	EXPECT_EQ(0, kvparse::remove_value("population_size", "250"));
+	EXPECT_FALSE(kvparse::keyword_exists("population_size"));
+	EXPECT_THROW(kvparse::parameter_value("population_size", ivalue, true), missing_keyword_error);
+
+	// snapshots include runtime values
+	kvparse_snapshot snap = kvparse::snapshot();
+	EXPECT_FALSE(snap.keyword_exists("population_size"));
+	EXPECT_TRUE(snap.parameter_value("new_key", ivalue));
+	EXPECT_EQ(7, ivalue);
+	EXPECT_EQ(1u, snap.values("metric").size());
+
+	EXPECT_THROW(kvparse::set_value("1bad", "x"), syntax_error);
+	EXPECT_THROW(kvparse::append_value("good", "  "), syntax_error);
+	// values that would not read back from a written configuration
+	EXPECT_THROW(kvparse::set_value("path", "dir#1"), syntax_error);
+	EXPECT_THROW(kvparse::append_value("path", "dir # 1"), syntax_error);
+	EXPECT_THROW(kvparse::set_value("a", "a\nb: c"), syntax_error);
+	EXPECT_THROW(kvparse::append_value("a", "a\rb: c"), syntax_error);
+	EXPECT_FALSE(kvparse::keyword_exists("path"));
+	EXPECT_FALSE(kvparse::keyword_exists("b"));
+
+	kvparse::clear();
+	EXPECT_FALSE(kvparse::keyword_exists("new_key"));
+}
+
+TEST(basic_parse_test, runtime_values_interpolation)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("base: /a\nout: ${base}/x\nnested: ${out}/y\n");
+	string svalue;
+	EXPECT_TRUE(kvparse::parameter_value("nested", svalue));
+	EXPECT_EQ("/a/x/y", svalue);
+
+	// references see runtime values, and memoized expansions are redone
+	kvparse::set_value("base", "/b");
+	EXPECT_TRUE(kvparse::parameter_value("out", svalue));
+	EXPECT_EQ("/b/x", svalue);
+	EXPECT_TRUE(kvparse::parameter_value("nested", svalue));
+	EXPECT_EQ("/b/x/y", svalue);
+	kvparse_snapshot snap = kvparse::snapshot();
+	EXPECT_TRUE(snap.parameter_value("out", svalue));
+	EXPECT_EQ("/b/x", svalue);
+
+	// a reference may name a keyword that exists only at run time
+	kvparse::read_configuration_buffer("late: ${added}/z\n");
+	kvparse::set_value("added", "/c");
+	EXPECT_TRUE(kvparse::parameter_value("late", svalue));
+	EXPECT_EQ("/c/z", svalue);
+
+	// a keyword removed or given several values at run time cannot be referred to
+	kvparse::append_value("base", "/d");
+	EXPECT_THROW(kvparse::parameter_value("out", svalue), std::exception);
+	kvparse::remove_value("added", "/c");
+	EXPECT_THROW(kvparse::parameter_value("late", svalue), std::exception);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, runtime_values_everywhere)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("# tuning\nmutation.rate: 0.1\nmutation.kind: swap\nsize: 10\n");
+	kvparse::set_value("mutation.rate", "0.5");
+	kvparse::set_value("mutation.extra", "1 2");
+	EXPECT_EQ(0, kvparse::remove_value("mutation.kind", "swap"));
+	kvparse::append_value("size", "20");
+
+	// values and tokens
+	kvparse_value_view rate = kvparse::values("mutation.rate");
+	ASSERT_EQ(1u, rate.size());
+	EXPECT_EQ("0.5", *rate.begin());
+	EXPECT_EQ(0u, kvparse::values("mutation.kind").size());
+	EXPECT_EQ(2u, kvparse::values("size").size());
+	int tokens = 0;
+	for(string_view t : kvparse::tokens("mutation.extra")) {
+		tokens += t.size();
+	}
+	EXPECT_EQ(2, tokens);
+
+	// prefix scans and sections
+	vector<string> keywords;
+	kvparse::for_each_with_prefix("mutation.", [&](string_view keyword, const kvparse::value_list& values) {
+		keywords.push_back(string(keyword) + "=" + string(values.front()));
+	});
+	vector<string> expected = { "mutation.extra=1 2", "mutation.rate=0.5" };
+	EXPECT_EQ(expected, keywords);
+	size_t in_section = 0;
+	kvparse::subconfig("mutation.").for_each([&](string_view, const kvparse::value_list&) { in_section++; });
+	EXPECT_EQ(2u, in_section);
+
+	// the dump and the writer
+	std::ostringstream dump;
+	kvparse::dump_contents(dump);
+	EXPECT_EQ("Keyword: mutation.extra  |  Values: 1 2 \nKeyword: mutation.rate  |  Values: 0.5 \n"
+			  "Keyword: size  |  Values: 10 20 \n", dump.str());
+	EXPECT_EQ("# tuning\nmutation.rate: 0.5\nsize: 10\nmutation.extra: 1 2\nsize: 20\n",
+			  kvparse::format_configuration("# tuning\nmutation.rate: 0.1\nmutation.kind: swap\nsize: 10\n"));
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, runtime_values_concurrent)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("shared_key: 0\n");
+	kvparse::set_thread_cache(true);
+
+	const int writers = 4;
+	const int changes = 2000;
+	vector<std::thread> threads;
+	for(int t=0; t<writers; t++) {
+		threads.push_back(std::thread([t]() {
+			string mine = "writer_" + std::to_string(t);
+			for(int i=1; i<=changes; i++) {
+				kvparse::set_value(mine, std::to_string(i));
+				kvparse::append_value("log_" + std::to_string(t), std::to_string(i));
+			}
+		}));
+	}
+	std::atomic<bool> bad(false);
+	threads.push_back(std::thread([&]() {
+		int last = 0;
+		for(int i=0; i<changes; i++) {
+			int value = 0;
+			if(kvparse::parameter_value("writer_0", value)) {
+				// one writer's values never go backwards
+				bad = bad || value < last;
+				last = value;
+			}
+		}
+	}));
+	for(unsigned int t=0; t<threads.size(); t++) {
+		threads[t].join();
+	}
+	EXPECT_FALSE(bad);
+
+	for(int t=0; t<writers; t++) {
+		int value = 0;
+		EXPECT_TRUE(kvparse::parameter_value("writer_" + std::to_string(t), value));
+		EXPECT_EQ(changes, value);
+		EXPECT_EQ((size_t)changes, kvparse::snapshot().values("log_" + std::to_string(t)).size());
+	}
+	kvparse::set_thread_cache(false);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, override_log)
+{
+	const char* filename = "test_override.log";
+	std::remove(filename);
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 100\nmetric: a\n");
+	EXPECT_EQ(0u, kvparse::open_override_log(filename));
+	kvparse::set_value("population_size", "250");
+	kvparse::append_value("metric", "b");
+	kvparse::set_value("removed", "x");
+	kvparse::remove_value("removed", "x");
+	kvparse::sync_override_log();
+	kvparse::clear();
+
+	// replayed on top of the files after a restart
+	int ivalue = 0;
+	kvparse::read_configuration_buffer("population_size: 100\nmetric: a\n");
+	EXPECT_EQ(3u, kvparse::open_override_log(filename));
+	EXPECT_TRUE(kvparse::parameter_value("population_size", ivalue));
+	EXPECT_EQ(250, ivalue);
+	EXPECT_EQ(2, std::ranges::distance(kvparse::snapshot().values("metric")));
+	EXPECT_FALSE(kvparse::keyword_exists("removed"));
+	kvparse::close_override_log();
+
+	// a record cut short by a crash is dropped
+	{
+		std::ofstream torn(filename, std::ios::app | std::ios::binary);
+		torn.write("\x20\0\0\0population", 14);
+	}
+	kvparse::clear();
+	EXPECT_EQ(3u, kvparse::open_override_log(filename));
+	EXPECT_TRUE(kvparse::parameter_value("population_size", ivalue));
+	EXPECT_EQ(250, ivalue);
+
+	// the log is rewritten once it grows past the threshold
+	kvparse::open_override_log(filename, 4096);
+	for(int i=0; i<2000; i++) {
+		kvparse::set_value("mutation_rate", std::to_string(i));
+	}
+	kvparse::close_override_log();
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	EXPECT_LT(in.tellg(), 2*4096);
+	kvparse::clear();
+	EXPECT_EQ(4u, kvparse::open_override_log(filename));
+	EXPECT_TRUE(kvparse::parameter_value("mutation_rate", ivalue));
+	EXPECT_EQ(1999, ivalue);
+	kvparse::clear();
+	std::remove(filename);
+}
+
+TEST(basic_parse_test, get_many)
+{
+	kvparse::clear();
+	string text;
+	for(int i=0; i<100; i++) {
+		text += "key_" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+	}
+	text += "pair: 1\npair: 2\nword: hello\ndangling: ${nowhere}\n";
+	kvparse::read_configuration_buffer(text);
+	kvparse::set_value("key_7", "700");
+
+	// more keywords than one batch, in no particular order
+	vector<string> names;
+	for(int i=99; i>=0; i-=3) {
+		names.push_back("key_" + std::to_string(i));
+	}
+	names.push_back("missing");
+	names.push_back("pair");
+	names.push_back("word");
+	names.push_back("dangling");
+	vector<string_view> keywords(names.begin(), names.end());
+
+	vector<std::expected<int,kv_error> > values(keywords.size());
+	kvparse::get_many<int>(keywords, values);
+	for(size_t i=0; i+4<keywords.size(); i++) {
+		ASSERT_TRUE(values[i].has_value()) << keywords[i];
+		int expected = 99-3*(int)i;
+		EXPECT_EQ(expected == 7 ? 700 : expected, *values[i]);
+	}
+	size_t n = keywords.size();
+	EXPECT_EQ(kv_errc::missing_keyword, values[n-4].error().code);
+	EXPECT_EQ(kv_errc::ambiguous_keyword, values[n-3].error().code);
+	EXPECT_EQ(kv_errc::illegal_value, values[n-2].error().code);
+	EXPECT_EQ(kv_errc::unresolved_reference, values[n-1].error().code);
+	EXPECT_EQ("dangling", values[n-1].error().keyword);
+
+	kvparse_snapshot snap = kvparse::snapshot();
+	vector<const kvparse_frozen::entry*> found(keywords.size());
+	snap.lookup_many(keywords, found);
+	kv_errc err;
+	EXPECT_EQ(snap.lookup(keywords[0], &err), found[0]);
+	EXPECT_EQ(0, found[n-4]);
+	ASSERT_NE((const kvparse_frozen::entry*)0, found[n-1]);
+	EXPECT_FALSE(found[n-1]->valid);
+
+	vector<std::expected<int,kv_error> > too_few(1);
+	EXPECT_THROW(snap.get_many<int>(keywords, too_few), runtime_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, get_many_between_writes)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("one: 1\ntwo: 2\nthree: 3\n");
+	vector<string_view> keywords = { "one", "two", "three", "four" };
+	vector<std::expected<int,kv_error> > values(keywords.size());
+
+	// straight after a load, before any snapshot
+	kvparse::set_value("one", "10");
+	kvparse::get_many<int>(keywords, values);
+	EXPECT_EQ(10, *values[0]);
+	EXPECT_EQ(2, *values[1]);
+	EXPECT_EQ(kv_errc::missing_keyword, values[3].error().code);
+
+	kvparse_snapshot before = kvparse::snapshot();
+	for(int i=0; i<3; i++) {
+		kvparse::set_value("two", std::to_string(20+i));
+		kvparse::get_many<int>(keywords, values);
+		EXPECT_EQ(20+i, *values[1]);
+	}
+	kvparse::append_value("four", "4");
+	kvparse::remove_value("three", "3");
+	kvparse::get_many<int>(keywords, values);
+	EXPECT_EQ(10, *values[0]);
+	EXPECT_EQ(22, *values[1]);
+	EXPECT_EQ(kv_errc::missing_keyword, values[2].error().code);
+	EXPECT_EQ(4, *values[3]);
+	for(size_t i=0; i<keywords.size(); i++) {
+		std::expected<int,kv_error> single = kvparse::try_get<int>(keywords[i]);
+		ASSERT_EQ(single.has_value(), values[i].has_value()) << keywords[i];
+	}
+	// the writes did not copy the loaded values again
+	EXPECT_EQ(before.values("one").data(), kvparse::snapshot().values("one").data());
+	EXPECT_EQ(2, *before.try_get<int>("two"));
+
+	vector<std::expected<int,kv_error> > too_few(1);
+	EXPECT_THROW(kvparse::get_many<int>(keywords, too_few), runtime_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, matrix_values)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer(
+		"distances: [\n"
+		"    0 4 7    # from a\n"
+		"    4 0 2;\n"
+		"\n"
+		"    7 2 0\n"
+		"]\n"
+		"weights: [0.5 1.5; 2.5 3.5]\n"
+		"ragged: [1 2; 3]\n"
+		"after: 1\n");
+
+	// the rows are joined into one stored value
+	string joined;
+	kvparse::parameter_value("distances", joined);
+	EXPECT_EQ("[0 4 7; 4 0 2;; 7 2 0]", joined);
+	int after = 0;
+	kvparse::parameter_value("after", after);
+	EXPECT_EQ(1, after);
+
+	kvparse_matrix<int> d;
+	ASSERT_TRUE(kvparse::parameter_value("distances", d));
+	ASSERT_EQ(3u, d.extent(0));
+	ASSERT_EQ(3u, d.extent(1));
+	EXPECT_EQ(7, (d[0, 2]));
+	EXPECT_EQ(2, (d[2, 1]));
+	EXPECT_EQ(d.data_handle()+3, d.row(1).data());
+
+	// rereading a value of the same shape keeps the buffer
+	const int* buffer = d.data_handle();
+	kvparse::parameter_value("distances", d);
+	EXPECT_EQ(buffer, d.data_handle());
+
+	kvparse_matrix<double> w(2, 2);
+	kvparse::snapshot().parameter_value("weights", w);
+	EXPECT_DOUBLE_EQ(3.5, (w[1, 1]));
+	kvparse_matrix<double> wrong(3, 3);
+	EXPECT_THROW(kvparse::parameter_value("weights", wrong), illegal_value_error);
+	EXPECT_THROW(kvparse::parameter_value("ragged", d), illegal_value_error);
+	EXPECT_THROW(kvparse::parameter_value("after", w), illegal_value_error);
+	kvparse_matrix<int> bad;
+	EXPECT_THROW(kvparse::parameter_value("weights", bad), illegal_value_error);
+	EXPECT_NO_THROW(kvparse::parameter_value("missing", bad));
+	EXPECT_THROW(kvparse::parameter_value("missing", bad, true), missing_keyword_error);
+
+	kvparse::set_value("weights", "[1 2 3]");
+	kvparse::parameter_value("weights", bad);
+	EXPECT_EQ(1u, bad.rows());
+	EXPECT_EQ(3u, bad.cols());
+
+	// layouts keep the rows as written until the value changes
+	string layout = "m: [\n  1 2  # first\n  3 4\n]\nn: 5\n";
+	kvparse::clear();
+	kvparse::read_configuration_buffer(layout);
+	EXPECT_EQ(layout, kvparse::format_configuration(layout));
+	kvparse::clear();
+	kvparse::read_configuration_buffer("m: [5 6; 7 8]\nn: 5\n");
+	EXPECT_EQ("m: [5 6; 7 8]\nn: 5\n", kvparse::format_configuration(layout));
+
+	// the rows of an entry that is gone go with it, and what is left parses
+	kvparse::clear();
+	kvparse::read_configuration_buffer("n: 5\n");
+	string out = kvparse::format_configuration(layout);
+	EXPECT_EQ("n: 5\n", out);
+	kvparse::clear();
+	EXPECT_NO_THROW(kvparse::read_configuration_buffer(out));
+	EXPECT_EQ(5, *kvparse::try_get<int>("n"));
+
+	// and so do those of an occurrence beyond the values left
+	string twice = "m: [\n  1 2\n]\nm: [\n  3 4\n  5 6\n]\nn: 5\n";
+	kvparse::clear();
+	kvparse::read_configuration_buffer(twice);
+	EXPECT_EQ(twice, kvparse::format_configuration(twice));
+	kvparse::clear();
+	kvparse::read_configuration_buffer("m: [1 2]\nn: 5\n");
+	out = kvparse::format_configuration(twice);
+	EXPECT_EQ("m: [\n  1 2\n]\nn: 5\n", out);
+	kvparse::clear();
+	EXPECT_NO_THROW(kvparse::read_configuration_buffer(out));
+	EXPECT_TRUE(kvparse::has_unique_value("m"));
+
+	// a bracket left open is an error, however the text arrives
+	kvparse::clear();
+	EXPECT_THROW(kvparse::read_configuration_buffer("m: [1 2\n3 4\n"), syntax_error);
+	EXPECT_THROW(kvparse::read_configuration_buffer("m: [1 2\n3 4] 5\n"), syntax_error);
+	kvparse_incremental_parser parser;
+	string text = "grid: [1 2\n3 4\n5 6]\n";
+	for(char c : text) {
+		parser.feed(&c, 1);
+	}
+	parser.finish();
+	kvparse_matrix<int> grid;
+	kvparse::parameter_value("grid", grid);
+	EXPECT_EQ(3u, grid.rows());
+	EXPECT_EQ(6, (grid[2, 1]));
+	parser.feed("open: [1\n", 6+3+1);
+	EXPECT_THROW(parser.finish(), syntax_error);
+}
+
+TEST(basic_parse_test, access_profile)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("alpha: 1\nbeta: 2\ngamma: 3\ndelta: 4 5\nzeta: 6\n");
+
+	kvparse::set_access_profiling(true);
+	int x;
+	for(int i=0; i<3; i++) {
+		kvparse::parameter_value("zeta", x);
+	}
+	kvparse_snapshot snap = kvparse::snapshot();
+	snap.try_get<int>("gamma");
+	snap.try_get<int>("gamma");
+	vector<int> v;
+	kvparse::parameter_value("delta", v);
+	kvparse::set_access_profiling(false);
+	kvparse::parameter_value("alpha", x);
+
+	vector<std::pair<string,uint64_t> > profile = kvparse::access_profile();
+	ASSERT_EQ(3u, profile.size());
+	EXPECT_EQ("zeta", profile[0].first);
+	EXPECT_EQ(3u, profile[0].second);
+	EXPECT_EQ("gamma", profile[1].first);
+	EXPECT_EQ("delta", profile[2].first);
+
+	const char* filename = "test_access.cfg.profile";
+	kvparse::write_access_profile(filename);
+	EXPECT_EQ(3u, kvparse::read_access_profile(filename));
+	std::remove(filename);
+	EXPECT_EQ(0u, kvparse::read_access_profile(filename));
+	{
+		std::ofstream out(filename);
+		out << "# a hand-written profile\n10 zeta\n5 gamma\n1 delta\n";
+	}
+	EXPECT_EQ(3u, kvparse::read_access_profile(filename));
+
+	// the hot keywords' values come first, in profile order
+	snap = kvparse::snapshot();
+	EXPECT_LT(snap.values("zeta").data(), snap.values("gamma").data());
+	EXPECT_LT(snap.values("gamma").data(), snap.values("delta").data());
+	EXPECT_LT(snap.values("delta").data(), snap.values("alpha").data());
+	EXPECT_EQ(6, *snap.try_get<int>("zeta"));
+	EXPECT_EQ(2u, snap.tokens("delta").size());
+
+	// prefix scans still go in keyword order
+	vector<string> keys;
+	snap.for_each_with_prefix("", [&](string_view k, const kvparse_frozen::entry&) { keys.push_back(string(k)); });
+	vector<string> expected = { "alpha", "beta", "delta", "gamma", "zeta" };
+	EXPECT_EQ(expected, keys);
+
+	// a reload keeps the profile
+	kvparse::clear();
+	kvparse::read_configuration_buffer("alpha: 1\nzeta: 6\n");
+	snap = kvparse::snapshot();
+	EXPECT_LT(snap.values("zeta").data(), snap.values("alpha").data());
+
+	{
+		std::ofstream out(filename);
+		out << "zeta\n";
+	}
+	EXPECT_THROW(kvparse::read_access_profile(filename), runtime_error);
+	std::remove(filename);
+	EXPECT_EQ(0u, kvparse::read_access_profile(filename));
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, enum_values)
+{
+	static_assert(*kvparse_enum_table<test_selection>::find("truncation") == test_selection::truncation);
+	static_assert(kvparse_enum_table<test_selection>::find("Truncation") == 0);
+	static_assert(kvparse_enum_table<test_selection>::find("") == 0);
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer(
+		"selection_operator: tournament\n"
+		"replacement_operator: \"steady_state\"\n"
+		"mutation_operator: swap\n"
+		"crossover_operator: roulette\n"
+		"crossover_operator: truncation\n");
+
+	test_selection sel = test_selection::roulette;
+	ASSERT_TRUE(kvparse::parameter_value("selection_operator", sel));
+	EXPECT_EQ(test_selection::tournament, sel);
+	EXPECT_EQ(test_selection::steady_state, *kvparse::try_get<test_selection>("replacement_operator"));
+	EXPECT_EQ(test_selection::tournament, *kvparse::snapshot().try_get<test_selection>("selection_operator"));
+	EXPECT_FALSE(kvparse::parameter_value("missing", sel));
+
+	EXPECT_EQ(kv_errc::illegal_value, kvparse::try_get<test_selection>("mutation_operator").error().code);
+	EXPECT_EQ(kv_errc::ambiguous_keyword, kvparse::try_get<test_selection>("crossover_operator").error().code);
+	try {
+		kvparse::parameter_value("mutation_operator", sel);
+		FAIL() << "expected illegal_value_error";
+	} catch(illegal_value_error& e) {
+		EXPECT_NE(string::npos, string(e.what()).find("'tournament','roulette','truncation','steady_state'")) << e.what();
+	}
+
+	// converted values are kept in the thread cache like any other type
+	kvparse::set_thread_cache(true);
+	EXPECT_EQ(test_selection::tournament, *kvparse::try_get<test_selection>("selection_operator"));
+	kvparse::set_value("selection_operator", "roulette");
+	EXPECT_EQ(test_selection::roulette, *kvparse::try_get<test_selection>("selection_operator"));
+	kvparse::set_thread_cache(false);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, thread_cache_coherence)
+{
+	kvparse::clear();
+	kvparse::set_thread_cache(true);
+	kvparse::read_configuration_buffer("population_size: 100\nselection_operator: tournament\n");
+
+	int ivalue = 0;
+	string svalue;
+	for(int i=0; i<3; i++) {
+		kvparse::parameter_value("population_size", ivalue);
+		EXPECT_EQ(100, ivalue);
+		kvparse::parameter_value("selection_operator", svalue);
+		EXPECT_EQ("tournament", svalue);
+	}
+
+	// any change to the database invalidates the cached values
+	kvparse::read_configuration_buffer("population_size: 200\n");
+	EXPECT_THROW(kvparse::parameter_value("population_size", ivalue), ambiguous_keyword_error);
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 300\n");
+	kvparse::parameter_value("population_size", ivalue);
+	EXPECT_EQ(300, ivalue);
+	EXPECT_FALSE(kvparse::parameter_value("selection_operator", svalue));
+
+	int other = 0;
+	std::thread reader([&]() { kvparse::parameter_value("population_size", other); });
+	reader.join();
+	EXPECT_EQ(300, other);
+
+	kvparse::set_thread_cache(false);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, format_round_trip)
+{
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config1.cfg");
+	// copy out, since clear() releases the interned strings
+	map<string,list<string> > before, after;
+	kvparse::for_each_with_prefix("", [&](string_view k, const kvparse::value_list& v) {
+		before[string(k)].assign(v.begin(), v.end());
+	});
+	string text = kvparse::format_configuration();
+
+	// the plain form reads back into the same database
+	kvparse::clear();
+	kvparse::read_configuration_buffer(text);
+	kvparse::for_each_with_prefix("", [&](string_view k, const kvparse::value_list& v) {
+		after[string(k)].assign(v.begin(), v.end());
+	});
+	EXPECT_EQ(before, after);
+
+	// with the original as the layout, nothing changes at all
+	std::ifstream in("tests/test_config1.cfg");
+	string original((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	EXPECT_EQ(original, kvparse::format_configuration(original));
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, format_preserves_layout)
+{
+	string layout =
+		"# search parameters\n"
+		"\tpopulation_size  =  100   # per island\n"
+		"islands: 4\n"
+		"\n"
+		"operator: swap\n"
+		"operator: invert\n"
+		"retired: yes\n";
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer(
+		"population_size: 250\n"
+		"islands: 4\n"
+		"operator: swap\n"
+		"operator: scramble\n"
+		"operator: insert\n"
+		"seed: 17\n");
+
+	EXPECT_EQ(
+		"# search parameters\n"
+		"\tpopulation_size  =  250   # per island\n"
+		"islands: 4\n"
+		"\n"
+		"operator: swap\n"
+		"operator: scramble\n"
+		"operator: insert\n"
+		"seed: 17\n",
+		kvparse::format_configuration(layout));
+
+	// a layout without a final newline still gets well-formed appends
+	EXPECT_EQ("islands: 4\noperator: swap\noperator: scramble\noperator: insert\npopulation_size: 250\nseed: 17\n",
+			  kvparse::format_configuration("islands: 4"));
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, write_configuration_file)
+{
+	const char* filename = "tests/written.cfg";
+	{
+		std::ofstream out(filename);
+		out << "# generated\nlimit: 10   # hard limit\nname: first\n";
+	}
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer("limit: 20\nname: first\nextra: 3\n");
+	EXPECT_TRUE(kvparse::write_configuration_file(filename));
+
+	std::ifstream in(filename);
+	string written((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	EXPECT_EQ("# generated\nlimit: 20   # hard limit\nname: first\nextra: 3\n", written);
+
+	EXPECT_TRUE(kvparse::write_configuration_file(filename, false));
+	kvparse::clear();
+	kvparse::read_configuration_file(filename);
+	int limit = 0;
+	kvparse::parameter_value("limit", limit);
+	EXPECT_EQ(20, limit);
+
+	std::remove(filename);
+	EXPECT_THROW(kvparse::write_configuration_file("no/such/dir/x.cfg"), std::runtime_error);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, shared_publish_and_refresh)
+{
+	kvparse::unpublish_shared("kvparse-test");
+	EXPECT_THROW(kvparse_shared reader("kvparse-test"), std::runtime_error);
+
+	kvparse::clear();
+	kvparse::read_configuration_buffer(
+		"population_size: 100\nmutation.rate: 0.01\nmutation.operator: swap\n"
+		"islands: 1 2 4\noperator: swap\noperator: invert\nlog: ${dir}/log\n");
+	EXPECT_EQ(1u, kvparse::publish_shared("kvparse-test"));
+
+	kvparse_shared reader("kvparse-test");
+	EXPECT_EQ(1u, reader.generation());
+	EXPECT_EQ(kvparse::version(), reader.version());
+	EXPECT_EQ(6u, reader.size());
+
+	int population = 0;
+	EXPECT_TRUE(reader.parameter_value("population_size", population, true));
+	EXPECT_EQ(100, population);
+	vector<int> islands;
+	reader.parameter_value("islands", islands);
+	EXPECT_EQ(vector<int>({1, 2, 4}), islands);
+	EXPECT_TRUE(reader.keyword_exists("operator"));
+	EXPECT_FALSE(reader.has_unique_value("operator"));
+	string op;
+	EXPECT_THROW(reader.parameter_value("operator", op), ambiguous_keyword_error);
+	EXPECT_THROW(reader.parameter_value("missing", op, true), missing_keyword_error);
+	EXPECT_EQ(kv_errc::unresolved_reference, reader.try_get<string>("log").error().code);
+
+	int n = 0;
+	reader.for_each_with_prefix("mutation.", [&](string_view k, const kvparse_shared::values& v) {
+		EXPECT_TRUE(k.starts_with("mutation."));
+		EXPECT_EQ(1u, v.size());
+		n++;
+	});
+	EXPECT_EQ(2, n);
+
+	// a new publish is only seen after refresh, and the old view stays intact
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 200\n");
+	EXPECT_EQ(2u, kvparse::publish_shared("kvparse-test"));
+	reader.parameter_value("population_size", population);
+	EXPECT_EQ(100, population);
+	EXPECT_TRUE(reader.refresh());
+	EXPECT_FALSE(reader.refresh());
+	EXPECT_EQ(2u, reader.generation());
+	reader.parameter_value("population_size", population);
+	EXPECT_EQ(200, population);
+	EXPECT_FALSE(reader.keyword_exists("islands"));
+
+	kvparse::unpublish_shared("kvparse-test");
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, shared_across_processes)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer("population_size: 300\nselection: tournament\n");
+	kvparse::publish_shared("/kvparse-test-fork");
+
+	pid_t pid = fork();
+	ASSERT_GE(pid, 0);
+	if(pid == 0) {
+		// the child reads the parent's database without parsing anything
+		kvparse::clear();
+		kvparse_shared reader("/kvparse-test-fork");
+		int population = 0;
+		string selection;
+		reader.parameter_value("population_size", population);
+		reader.parameter_value("selection", selection);
+		_exit(population == 300 && selection == "tournament" ? 0 : 1);
+	}
+	int status = 0;
+	waitpid(pid, &status, 0);
+	EXPECT_TRUE(WIFEXITED(status));
+	EXPECT_EQ(0, WEXITSTATUS(status));
+
+	kvparse::unpublish_shared("/kvparse-test-fork");
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, protocol_pipelined_requests)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer(
+		"mutation.rate: 0.01\nmutation.operator: swap\noperator: swap\noperator: invert\n"
+		"log: ${dir}/log\nname: ga\n");
+	kvparse_snapshot db = kvparse::snapshot();
+
+	string requests;
+	kvparse_protocol::encode_request(requests, 7, kvparse_protocol::get, {"name", "operator", "missing", "log"});
+	kvparse_protocol::encode_request(requests, 8, kvparse_protocol::prefix, {"mutation."});
+
+	// feed the requests a byte at a time; nothing is answered until a frame is complete
+	string in, out;
+	bool malformed = false;
+	for(unsigned int i=0; i<requests.size(); i++) {
+		in.push_back(requests[i]);
+		in.erase(0, kvparse_protocol::serve(in, db, out, &malformed));
+		EXPECT_FALSE(malformed);
+	}
+	EXPECT_TRUE(in.empty());
+
+	kvparse_protocol::response res;
+	size_t used = kvparse_protocol::decode_response(out, res);
+	ASSERT_GT(used, 0u);
+	EXPECT_EQ(7u, res.id);
+	EXPECT_EQ(kvparse_protocol::ok, res.status);
+	EXPECT_EQ(db.version(), res.version);
+	ASSERT_EQ(4u, res.entries.size());
+	EXPECT_EQ("name", res.entries[0].keyword);
+	EXPECT_EQ(0, res.entries[0].code);
+	EXPECT_EQ(vector<string_view>({"ga"}), res.entries[0].values);
+	EXPECT_EQ(vector<string_view>({"swap", "invert"}), res.entries[1].values);
+	EXPECT_EQ(1+(int)kv_errc::missing_keyword, res.entries[2].code);
+	EXPECT_EQ(1+(int)kv_errc::unresolved_reference, res.entries[3].code);
+
+	string_view rest = string_view(out).substr(used);
+	used = kvparse_protocol::decode_response(rest, res);
+	EXPECT_EQ(rest.size(), used);
+	EXPECT_EQ(8u, res.id);
+	ASSERT_EQ(2u, res.entries.size());
+	EXPECT_EQ("mutation.operator", res.entries[0].keyword);
+	EXPECT_EQ("mutation.rate", res.entries[1].keyword);
+
+	// a truncated response is not decoded
+	EXPECT_EQ(0u, kvparse_protocol::decode_response(rest.substr(0, rest.size()-1), res));
+
+	// a frame with an unknown op gets an error reply; an oversized one is fatal
+	string bad("\x05\x00\x00\x00\x09\x00\x00\x00\x7f", 9);
+	out.clear();
+	EXPECT_EQ(bad.size(), kvparse_protocol::serve(bad, db, out, &malformed));
+	EXPECT_FALSE(malformed);
+	kvparse_protocol::decode_response(out, res);
+	EXPECT_EQ(9u, res.id);
+	EXPECT_EQ(kvparse_protocol::bad_request, res.status);
+	EXPECT_EQ(0u, kvparse_protocol::serve(string("\xff\xff\xff\xff", 4), db, out, &malformed));
+	EXPECT_TRUE(malformed);
+	kvparse::clear();
+}
+
+static_assert(std::ranges::forward_range<kvparse_token_view> && std::ranges::view<kvparse_token_view>);
+static_assert(std::ranges::input_range<decltype(kvparse::tokens(""))>);
+
+TEST(basic_parse_test, value_and_token_views)
+{
+	kvparse::clear();
+	kvparse::read_configuration_buffer(
+		"islands: 1 2\nislands:\t4   8 \noperator: swap\npath: ${dir}/x\ndir: /tmp\n");
+
+	vector<string_view> values(kvparse::values("islands").begin(), kvparse::values("islands").end());
+	EXPECT_EQ(vector<string_view>({"1 2", "4   8"}), values);
+	EXPECT_TRUE(kvparse::values("missing").empty());
+	EXPECT_EQ("/tmp/x", *kvparse::values("path").begin());
+
+	vector<string_view> tokens;
+	for(string_view t : kvparse::tokens("islands")) {
+		tokens.push_back(t);
+	}
+	EXPECT_EQ(vector<string_view>({"1", "2", "4", "8"}), tokens);
+	EXPECT_EQ(1, std::ranges::distance(kvparse::tokens("operator")));
+	EXPECT_EQ(0, std::ranges::distance(kvparse::tokens("missing")));
+	EXPECT_EQ(0, std::ranges::distance(kvparse_token_view(" \t ")));
+
+	// snapshots precompute the token boundaries
+	kvparse_snapshot snap = kvparse::snapshot();
+	std::span<const string_view> st = snap.tokens("islands");
+	EXPECT_EQ(tokens, vector<string_view>(st.begin(), st.end()));
+	EXPECT_EQ(2u, snap.values("islands").size());
+	EXPECT_EQ("/tmp/x", snap.tokens("path")[0]);
+	EXPECT_TRUE(snap.tokens("missing").empty());
+	kvparse::clear();
+}
+
+// compress text into a gzip file, optionally as several concatenated members
+static void write_gzip(const char* filename, const string& text, int members=1)
+{
+	std::ofstream(filename, std::ios::binary | std::ios::trunc);
+	size_t step = text.size()/members+1;
+	for(size_t at=0; at<text.size(); at+=step) {
+		gzFile gz = gzopen(filename, "ab");
+		gzwrite(gz, text.data()+at, std::min(step, text.size()-at));
+		gzclose(gz);
+	}
+}
+
+static map<string,list<string> > database_contents()
+{
+	map<string,list<string> > contents;
+	kvparse::for_each_with_prefix("", [&](string_view k, const kvparse::value_list& v) {
+		contents[string(k)].assign(v.begin(), v.end());
+	});
+	return contents;
+}
+
+TEST(basic_parse_test, gzip_files)
+{
+	std::ifstream in("tests/test_config1.cfg");
+	string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config1.cfg");
+	map<string,list<string> > expected = database_contents();
+
+	const char* filename = "tests/compressed.cfg.gz";
+	for(int members=1; members<=3; members++) {
+		write_gzip(filename, text, members);
+		kvparse::clear();
+		kvparse::read_configuration_file(filename);
+		EXPECT_EQ(expected, database_contents()) << members << " members";
+	}
+
+	// lines that straddle decompression blocks are reassembled
+	string big;
+	for(int i=0; i<20000; i++) {
+		big += "parameter_" + std::to_string(i) + ": " + string(i % 50, 'x') + std::to_string(i) + "\n";
+	}
+	big += "last: 1";
+	write_gzip(filename, big);
+	kvparse::clear();
+	kvparse::read_configuration_file(filename);
+	int last = 0;
+	kvparse::parameter_value("last", last);
+	EXPECT_EQ(1, last);
+	EXPECT_EQ(string(19999 % 50, 'x') + "19999", *kvparse::values("parameter_19999").begin());
+
+	// compressed data in memory, and through the asynchronous loader
+	std::ifstream gz(filename, std::ios::binary);
+	string compressed((std::istreambuf_iterator<char>(gz)), std::istreambuf_iterator<char>());
+	kvparse::clear();
+	kvparse::read_configuration_buffer(compressed);
+	EXPECT_TRUE(kvparse::keyword_exists("parameter_12345"));
+	kvparse::clear();
+	kvparse::read_configuration_file_async(filename).get();
+	EXPECT_TRUE(kvparse::keyword_exists("parameter_12345"));
+
+	// truncated and corrupt data are reported
+	std::ofstream(filename, std::ios::binary | std::ios::trunc) << compressed.substr(0, compressed.size()/2);
+	EXPECT_THROW(kvparse::read_configuration_file(filename), std::runtime_error);
+	string corrupt = compressed;
+	corrupt[20] ^= 0x55;
+	EXPECT_THROW(kvparse::read_configuration_buffer(corrupt), std::runtime_error);
+	EXPECT_THROW(kvparse::read_configuration_buffer(string("\x28\xb5\x2f\xfd\0\0", 6)), std::runtime_error);
+
+	std::remove(filename);
+	kvparse::clear();
+}
+
+TEST(basic_parse_test, load_stats)
+{
+	kvparse::clear();
+	kvparse::load_stats stats;
+	memset(&stats, 0xff, sizeof(stats));
+	kvparse::read_configuration_file("tests/test_config12.cfg", &stats);
+
+#ifndef KVPARSE_NO_LOAD_STATS
+	// "first: 1\nlast: 12" has no trailing newline
+	EXPECT_EQ(17u, stats.bytes);
+	EXPECT_EQ(2u, stats.lines);
+	EXPECT_EQ(2u, stats.entries);
+	EXPECT_EQ(8u, stats.longest_line);
+	EXPECT_GE(stats.allocations, 2*2u);
+	EXPECT_GT(stats.total_seconds, 0.0);
+	EXPECT_GE(stats.total_seconds, stats.io_seconds+stats.comment_seconds+stats.validate_seconds+
+			  stats.trim_seconds+stats.insert_seconds);
+	EXPECT_EQ(0.0, stats.decompress_seconds);
+
+	// blank and comment lines are counted but insert nothing
+	kvparse::clear();
+	kvparse::read_configuration_file("tests/test_config1.cfg", &stats);
+	EXPECT_EQ(57u, stats.lines);
+	EXPECT_EQ(46u, stats.entries);
+
+	// a failed load leaves the statistics untouched
+	stats.lines = 12345;
+	EXPECT_THROW(kvparse::read_configuration_file("tests/no_such_file.cfg", &stats), std::runtime_error);
+	EXPECT_EQ(12345u, stats.lines);
+#endif
+	kvparse::clear();
+}
+
+// a memory resource that counts the requests reaching it
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+	size_t allocations;
+	size_t deallocations;
+
+	counting_resource() : allocations(0), deallocations(0) {}
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override {
+		allocations++;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+	void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+		deallocations++;
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+	bool do_is_equal(const std::pmr::memory_resource& that) const noexcept override {
+		return this == &that;
+	}
+};
+
+TEST(basic_parse_test, memory_resource_allocation_counts)
+{
+	int ivalue = 0;
+
+	// every map node, list node and pool block is a separate allocation
+	counting_resource direct;
+	kvparse::set_memory_resource(&direct);
+	EXPECT_EQ(&direct, kvparse::get_memory_resource());
+	kvparse::read_configuration_file("tests/test_config1.cfg");
+	kvparse::parameter_value("integer1", ivalue);
+	EXPECT_EQ(1, ivalue);
+	size_t individual = direct.allocations;
+	EXPECT_GT(individual, 2*46u);
+
+	// layers come from the same resource
+	kvparse::define_layer("overrides", 10);
+	kvparse::read_layer_buffer("overrides", "integer1: 100\n");
+	kvparse::parameter_value("integer1", ivalue);
+	EXPECT_EQ(100, ivalue);
+	EXPECT_GT(direct.allocations, individual);
+
+	// an arena turns them into a handful of large requests
+	counting_resource upstream;
+	{
+		std::pmr::monotonic_buffer_resource arena(64*1024, &upstream);
+		kvparse::set_memory_resource(&arena);
+		kvparse::read_configuration_file("tests/test_config1.cfg");
+		kvparse::parameter_value("integer1", ivalue);
+		EXPECT_EQ(1, ivalue);
+		EXPECT_LE(upstream.allocations, 2u);
+		EXPECT_LT(upstream.allocations*10, individual);
+		kvparse::set_memory_resource(0);
+	}
+
+	// everything has been handed back
+	EXPECT_EQ(direct.allocations, direct.deallocations);
+	EXPECT_EQ(upstream.allocations, upstream.deallocations);
+	EXPECT_EQ(std::pmr::get_default_resource(), kvparse::get_memory_resource());
+	kvparse::clear();
+}
+
+constexpr string_view embedded_text =
+	"# compiled-in defaults\n"
+	"population_size: 100\n"
+	"mutation.rate = 0.25   # trailing comment\n"
+	"\n"
+	"elitism: yes\n"
+	"temperature: -1.5\n"
+	"selection: tournament\n"
+	"operators: swap\n"
+	"operators: invert\n";
+
+constexpr auto embedded = KVPARSE_DEFAULTS(embedded_text);
+
+// the whole table is worked out by the compiler
+static_assert(embedded.size() == 7);
+static_assert(embedded.find("population_size")->kind == kvparse_default_entry::integer_value);
+static_assert(embedded.find("population_size")->integer == 100);
+static_assert(embedded.find("mutation.rate")->real == 0.25);
+static_assert(embedded.find("mutation.rate")->value == "0.25");
+static_assert(embedded.find("elitism")->boolean);
+static_assert(embedded.find("temperature")->real == -1.5);
+static_assert(embedded.find("selection")->kind == kvparse_default_entry::string_value);
+static_assert(embedded.find("missing") == 0);
+static_assert(kvparse_count_defaults("a: 1\nb = 2\n# c: 3\nd': x") == 3);
+static_assert(kvparse_count_defaults("m: [1 0; 0 1]\n") == 1);
+
+TEST(basic_parse_test, embedded_defaults)
+{
+	int ivalue = 0;
+	double dvalue = 0;
+	bool bvalue = false;
+	string svalue;
+
+	kvparse::read_defaults(embedded);
+	EXPECT_TRUE(kvparse::parameter_value("population_size", ivalue, true));
+	EXPECT_EQ(100, ivalue);
+	EXPECT_TRUE(kvparse::parameter_value("mutation.rate", dvalue, true));
+	EXPECT_DOUBLE_EQ(0.25, dvalue);
+	EXPECT_TRUE(kvparse::parameter_value("elitism", bvalue, true));
+	EXPECT_TRUE(bvalue);
+	EXPECT_TRUE(kvparse::parameter_value("selection", svalue, true));
+	EXPECT_EQ("tournament", svalue);
+	EXPECT_FALSE(kvparse::has_unique_value("operators"));
+	EXPECT_EQ(2, std::ranges::distance(kvparse::values("operators")));
+
+	kvparse::clear();
+
+	// a layer above the defaults replaces them keyword by keyword
+	kvparse::define_layer("defaults", 0);
+	kvparse::define_layer("file", 10);
+	kvparse::read_layer_defaults("defaults", embedded);
+	kvparse::read_layer_buffer("file", "population_size: 50\n");
+	EXPECT_TRUE(kvparse::parameter_value("population_size", ivalue, true));
+	EXPECT_EQ(50, ivalue);
+	EXPECT_TRUE(kvparse::parameter_value("mutation.rate", dvalue, true));
+	EXPECT_DOUBLE_EQ(0.25, dvalue);
+	EXPECT_EQ("defaults", kvparse::source_layer("mutation.rate"));
+	kvparse::clear();
+}
+
 // The fixture for testing class Foo.
 class kvparse_test : public ::testing::Test {
 protected:
@@ -393,6 +2043,47 @@ TEST_F(kvparse_test, bool_optional_false)
 	EXPECT_FALSE(bvalue);
 }
 
+TEST_F(kvparse_test, try_get_values)
+{
+	std::expected<int,kv_error> i = kvparse::try_get<int>("integer7");
+	ASSERT_TRUE(i.has_value());
+	EXPECT_EQ(-7, *i);
+
+	std::expected<double,kv_error> d = kvparse::try_get<double>("double_param8");
+	ASSERT_TRUE(d.has_value());
+	EXPECT_DOUBLE_EQ(-0.5, *d);
+
+	std::expected<bool,kv_error> b = kvparse::try_get<bool>("bool5");
+	ASSERT_TRUE(b.has_value());
+	EXPECT_TRUE(*b);
+
+	std::expected<string_view,kv_error> sv = kvparse::try_get<string_view>("string3");
+	ASSERT_TRUE(sv.has_value());
+	EXPECT_EQ("This is a multiword string", *sv);
+}
+
+TEST_F(kvparse_test, try_get_errors)
+{
+	string missing = "integer99";
+	std::expected<int,kv_error> i = kvparse::try_get<int>(missing);
+	ASSERT_FALSE(i.has_value());
+	EXPECT_EQ(kv_errc::missing_keyword, i.error().code);
+	EXPECT_EQ(missing.data(), i.error().keyword.data());
+
+	i = kvparse::try_get<int>("integer13");
+	ASSERT_FALSE(i.has_value());
+	EXPECT_EQ(kv_errc::ambiguous_keyword, i.error().code);
+
+	i = kvparse::try_get<int>("integer10");
+	ASSERT_FALSE(i.has_value());
+	EXPECT_EQ(kv_errc::illegal_value, i.error().code);
+	EXPECT_EQ("integer10", i.error().keyword);
+
+	EXPECT_FALSE(kvparse::try_get<unsigned int>("uint-param2").has_value());
+	EXPECT_FALSE(kvparse::try_get<double>("double_param-4").has_value());
+	EXPECT_FALSE(kvparse::try_get<bool>("bool9").has_value());
+}
+
 TEST_F(kvparse_test, string_list) 
 {
 	kvparse::parameter_value("string_vals", lsvalue);